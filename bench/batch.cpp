@@ -0,0 +1,87 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "joml.hpp"
+
+// Measures how parseBatch scales with the number of threads. Pass JOML files to parse those,
+// otherwise a few thousand small generated documents are used.
+
+std::string generateDocument(size_t index)
+{
+    std::string doc = "# tenant " + std::to_string(index) + "\n";
+    doc += "name: \"tenant-" + std::to_string(index) + "\"\n";
+    doc += "enabled: true\n";
+    doc += "limits: {cpu: 1.5, memory: 0x40000000, connections: 512,}\n";
+    for (size_t i = 0; i < 20; ++i) {
+        const auto n = std::to_string(i);
+        doc += "feature_" + n + ": {\n";
+        doc += "    weight: 0." + std::to_string((index * 31 + i * 17) % 1000) + "\n";
+        doc += "    tags: [\"a\", \"b\\tc\", \"" + n + "\"]  # comment\n";
+        doc += "    threshold: " + std::to_string(index * i) + "\n";
+        doc += "}\n";
+    }
+    return doc;
+}
+
+std::vector<std::string> loadSources(const std::vector<std::string>& paths)
+{
+    std::vector<std::string> sources;
+    for (const auto& path : paths) {
+        std::ifstream file(path);
+        std::stringstream ss;
+        ss << file.rdbuf();
+        sources.push_back(ss.str());
+    }
+    if (sources.empty()) {
+        for (size_t i = 0; i < 5000; ++i) {
+            sources.push_back(generateDocument(i));
+        }
+    }
+    return sources;
+}
+
+int main(int argc, char** argv)
+{
+    const auto sources = loadSources(std::vector<std::string>(argv + 1, argv + argc));
+    const std::vector<std::string_view> views(sources.begin(), sources.end());
+    size_t totalSize = 0;
+    for (const auto& source : sources) {
+        totalSize += source.size();
+    }
+
+    const auto maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::cout << sources.size() << " documents, " << totalSize << " bytes, " << maxThreads
+              << " hardware threads" << std::endl;
+    std::cout << "threads  docs/s  MB/s  speedup" << std::endl;
+
+    double singleThreaded = 0.0;
+    for (size_t numThreads = 1; numThreads <= maxThreads * 2; numThreads *= 2) {
+        // best of a few runs
+        double best = 0.0;
+        for (int run = 0; run < 5; ++run) {
+            const auto start = std::chrono::steady_clock::now();
+            const auto results = joml::parseBatch(views, {}, numThreads);
+            const std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+            for (const auto& res : results) {
+                if (!res) {
+                    std::cerr << "Error parsing JOML: " << res.error().string() << std::endl;
+                    return 1;
+                }
+            }
+            if (best == 0.0 || time.count() < best) {
+                best = time.count();
+            }
+        }
+        if (numThreads == 1) {
+            singleThreaded = best;
+        }
+        std::cout << numThreads << "  " << static_cast<size_t>(sources.size() / best) << "  "
+                  << totalSize / best / 1e6 << "  " << singleThreaded / best << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "joml.hpp"
+
+// Measures parsing and writing on generated corpora and prints the results as JSON, so the output
+// of two versions can be diffed. Usage: joml-bench [--size MiB] [--runs N] [corpus or file...]
+// The corpora are generated from a fixed seed and are the same on every platform. Arguments that
+// are not the name of a corpus are read as JOML files.
+
+std::atomic<size_t> allocations { 0 };
+std::atomic<size_t> allocatedBytes { 0 };
+
+// Every allocation of the library ends up in one of these, the blocks of document arenas in the
+// aligned one
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (auto ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    const auto align = static_cast<size_t>(alignment);
+#ifdef _WIN32
+    auto ptr = ::_aligned_malloc(size ? size : 1, align);
+#else
+    // the size has to be a multiple of the alignment
+    auto ptr = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align);
+#endif
+    if (ptr) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    ::_aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+
+// splitmix64, because the distributions of <random> differ between standard libraries
+class Random {
+public:
+    uint64_t next()
+    {
+        state_ += 0x9e3779b97f4a7c15;
+        auto z = state_;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // in [0, n)
+    size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+
+    std::string word(size_t minLength, size_t maxLength)
+    {
+        std::string str;
+        const auto length = minLength + below(maxLength - minLength + 1);
+        for (size_t i = 0; i < length; ++i) {
+            str.push_back(static_cast<char>('a' + below(26)));
+        }
+        return str;
+    }
+
+private:
+    uint64_t state_ = 0x4a4f4d4c; // "JOML"
+};
+
+// Chains of nested dictionaries and arrays, a few hundred levels deep
+std::string generateDeep(size_t size, Random& random)
+{
+    std::string doc;
+    for (size_t entry = 0; doc.size() < size; ++entry) {
+        doc += "chain_" + std::to_string(entry) + ": ";
+        const auto depth = 100 + random.below(200);
+        for (size_t i = 0; i < depth; ++i) {
+            doc += i % 2 ? "[" : "{" + random.word(1, 8) + ": ";
+        }
+        doc += std::to_string(random.below(1000));
+        for (size_t i = depth; i-- > 0;) {
+            doc += i % 2 ? "]" : "\n}";
+        }
+        doc += "\n";
+    }
+    return doc;
+}
+
+// A single root dictionary with a huge number of short entries
+std::string generateWide(size_t size, Random& random)
+{
+    std::string doc;
+    for (size_t entry = 0; doc.size() < size; ++entry) {
+        doc += random.word(4, 12) + "_" + std::to_string(entry) + ": ";
+        doc += std::to_string(random.below(1000000)) + "\n";
+    }
+    return doc;
+}
+
+// Long strings with every kind of escape sequence
+std::string generateStrings(size_t size, Random& random)
+{
+    static const std::vector<std::string> escapes { "\\n", "\\t", "\\\"", "\\\\", "\\u00e9",
+        "\\U0001F600", "\\x41", "\\r" };
+    std::string doc;
+    for (size_t entry = 0; doc.size() < size; ++entry) {
+        doc += "text_" + std::to_string(entry) + ": \"";
+        const auto words = 20 + random.below(300);
+        for (size_t i = 0; i < words; ++i) {
+            doc += random.word(1, 10);
+            doc += random.below(8) == 0 ? escapes[random.below(escapes.size())] : " ";
+        }
+        doc += "\"\n";
+    }
+    return doc;
+}
+
+// Arrays of integers and floats in the different notations
+std::string generateNumbers(size_t size, Random& random)
+{
+    std::string doc;
+    for (size_t entry = 0; doc.size() < size; ++entry) {
+        doc += "values_" + std::to_string(entry) + ": [";
+        for (size_t i = 0; i < 64; ++i) {
+            if (i > 0) {
+                doc += ", ";
+            }
+            const auto n = random.below(1000000);
+            switch (random.below(6)) {
+            case 0:
+                doc += "-" + std::to_string(n);
+                break;
+            case 1:
+                doc += std::to_string(n) + "." + std::to_string(random.below(1000));
+                break;
+            case 2:
+                doc += std::to_string(n % 1000) + "." + std::to_string(n) + "e-"
+                    + std::to_string(random.below(30));
+                break;
+            case 3: {
+                char hex[16];
+                std::snprintf(hex, sizeof(hex), "0x%zx", n);
+                doc += hex;
+                break;
+            }
+            default:
+                doc += std::to_string(n);
+            }
+        }
+        doc += "]\n";
+    }
+    return doc;
+}
+
+// Mostly comments, with a few small entries in between
+std::string generateComments(size_t size, Random& random)
+{
+    std::string doc;
+    for (size_t entry = 0; doc.size() < size; ++entry) {
+        const auto lines = 2 + random.below(6);
+        for (size_t i = 0; i < lines; ++i) {
+            doc += "# ";
+            const auto words = 3 + random.below(12);
+            for (size_t w = 0; w < words; ++w) {
+                doc += random.word(2, 9) + " ";
+            }
+            doc += "\n";
+        }
+        doc += "option_" + std::to_string(entry) + ": " + std::to_string(random.below(100))
+            + "  # " + random.word(5, 20) + "\n";
+    }
+    return doc;
+}
+
+// Looks like the configuration of a fleet of services
+std::string generateConfig(size_t size, Random& random)
+{
+    std::string doc;
+    for (size_t entry = 0; doc.size() < size; ++entry) {
+        const auto name = random.word(4, 10);
+        doc += "# " + name + " service\n";
+        doc += "service_" + std::to_string(entry) + ": {\n";
+        doc += "    name: \"" + name + "\"\n";
+        doc += "    enabled: " + std::string(random.below(2) ? "true" : "false") + "\n";
+        doc += "    replicas: " + std::to_string(1 + random.below(16)) + "\n";
+        doc += "    image: \"registry.example.com/" + name + ":" + std::to_string(random.below(99))
+            + "." + std::to_string(random.below(99)) + "\"\n";
+        doc += "    limits: {cpu: " + std::to_string(random.below(8)) + ".5, memory: 0x"
+            + std::to_string(10 + random.below(90)) + "000000,}\n";
+        doc += "    env: {\n";
+        const auto vars = 2 + random.below(8);
+        for (size_t i = 0; i < vars; ++i) {
+            doc += "        " + random.word(3, 12) + ": \"" + random.word(5, 30) + "\"\n";
+        }
+        doc += "    }\n";
+        doc += "    ports: [" + std::to_string(8000 + random.below(1000)) + ", "
+            + std::to_string(9000 + random.below(1000)) + "]\n";
+        doc += "    healthcheck: {path: \"/health\", interval: 2.5, timeout: null,}\n";
+        doc += "}\n";
+    }
+    return doc;
+}
+
+struct Corpus {
+    std::string name;
+    std::string source;
+};
+
+using Generator = std::string (*)(size_t size, Random& random);
+
+const std::vector<std::pair<std::string, Generator>> generators {
+    { "deep", generateDeep },
+    { "wide", generateWide },
+    { "strings", generateStrings },
+    { "numbers", generateNumbers },
+    { "comments", generateComments },
+    { "config", generateConfig },
+};
+
+std::optional<Corpus> loadCorpus(const std::string& arg, size_t size)
+{
+    for (const auto& [name, generator] : generators) {
+        if (name == arg) {
+            Random random;
+            return Corpus { arg, generator(size, random) };
+        }
+    }
+    std::ifstream file(arg, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return Corpus { arg, ss.str() };
+}
+
+// Counts the nodes without recursion, because the deep corpus would overflow the stack
+size_t countNodes(const joml::Node& root)
+{
+    size_t count = 0;
+    std::vector<const joml::Node*> stack { &root };
+    while (!stack.empty()) {
+        const auto node = stack.back();
+        stack.pop_back();
+        count++;
+        if (node->isArray()) {
+            for (const auto& element : node->asArray()) {
+                stack.push_back(&element);
+            }
+        } else if (node->isDictionary()) {
+            for (const auto& [key, value] : node->asDictionary()) {
+                stack.push_back(&value);
+            }
+        }
+    }
+    return count;
+}
+
+// The peak resident set size in KiB since the last call. Only Linux can reset the peak.
+std::optional<size_t> peakRss()
+{
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    std::optional<size_t> peak;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            peak = std::strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    std::ofstream("/proc/self/clear_refs") << "5";
+    return peak;
+#else
+    return std::nullopt;
+#endif
+}
+
+// Discards everything, but counts it
+class NullSink : public joml::Sink {
+public:
+    bool write(std::string_view data) override
+    {
+        size += data.size();
+        return true;
+    }
+
+    size_t size = 0;
+};
+
+void add(joml::Node::Dictionary& dict, std::string_view key, joml::Node value)
+{
+    dict.emplace_back(joml::String(key), std::move(value));
+}
+
+joml::Node integer(size_t n)
+{
+    return joml::Node(static_cast<joml::Node::Integer>(n));
+}
+
+// Runs parse a few times and reports the fastest run. The result is destroyed after the clock
+// stops, so only parsing is measured.
+template <typename Parse>
+std::optional<joml::Node> measureParse(const Corpus& corpus, size_t nodes, size_t runs, Parse parse)
+{
+    double best = 0.0;
+    size_t runAllocations = 0;
+    size_t runBytes = 0;
+    peakRss();
+    for (size_t run = 0; run < runs; ++run) {
+        allocations = 0;
+        allocatedBytes = 0;
+        const auto start = std::chrono::steady_clock::now();
+        const auto res = parse(corpus.source);
+        const std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        runAllocations = allocations;
+        runBytes = allocatedBytes;
+        if (!res) {
+            std::cerr << corpus.name << ": " << res.error().string() << std::endl;
+            return std::nullopt;
+        }
+        if (run == 0 || time.count() < best) {
+            best = time.count();
+        }
+    }
+    const auto peak = peakRss();
+
+    joml::Node::Dictionary result;
+    add(result, "seconds", best);
+    add(result, "mbPerSecond", corpus.source.size() / best / 1e6);
+    add(result, "nodesPerSecond", nodes / best);
+    add(result, "allocations", integer(runAllocations));
+    add(result, "allocatedBytes", integer(runBytes));
+    add(result, "peakRssKiB", peak ? integer(*peak) : joml::Node(joml::Node::Null {}));
+    return joml::Node(std::move(result));
+}
+
+template <typename Writer>
+joml::Node measureWrite(const joml::Node& root, size_t runs)
+{
+    double best = 0.0;
+    NullSink sink;
+    Writer writer(sink);
+    for (size_t run = 0; run < runs; ++run) {
+        sink.size = 0;
+        const auto start = std::chrono::steady_clock::now();
+        writer.write(root);
+        const std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        if (run == 0 || time.count() < best) {
+            best = time.count();
+        }
+    }
+
+    joml::Node::Dictionary result;
+    add(result, "seconds", best);
+    add(result, "outputBytes", integer(sink.size));
+    add(result, "mbPerSecond", sink.size / best / 1e6);
+    return joml::Node(std::move(result));
+}
+
+std::optional<joml::Node> benchmark(const Corpus& corpus, size_t runs)
+{
+    // The tree for the writers is only parsed afterwards, so it does not count towards the peak
+    // RSS of the parses
+    size_t nodes = 0;
+    {
+        const auto doc = joml::parse(corpus.source, joml::ParseOptions {});
+        if (!doc) {
+            std::cerr << corpus.name << ": " << doc.error().string() << std::endl;
+            return std::nullopt;
+        }
+        nodes = countNodes((*doc).root());
+    }
+
+    joml::Node::Dictionary result;
+    add(result, "name", joml::String(corpus.name));
+    add(result, "bytes", integer(corpus.source.size()));
+    add(result, "nodes", integer(nodes));
+
+    const auto parseDocument = [](std::string_view str) {
+        return joml::parse(str, joml::ParseOptions {});
+    };
+    const auto parseZeroCopy = [](std::string_view str) {
+        joml::ParseOptions options;
+        options.zeroCopy = true;
+        return joml::parse(str, options);
+    };
+    const auto parseTape = [](std::string_view str) { return joml::parseTape(str); };
+    auto document = measureParse(corpus, nodes, runs, parseDocument);
+    auto zeroCopy = measureParse(corpus, nodes, runs, parseZeroCopy);
+    auto tape = measureParse(corpus, nodes, runs, parseTape);
+    if (!document || !zeroCopy || !tape) {
+        return std::nullopt;
+    }
+    add(result, "parse", std::move(*document));
+    add(result, "parseZeroCopy", std::move(*zeroCopy));
+    add(result, "parseTape", std::move(*tape));
+
+    const auto doc = joml::parse(corpus.source, joml::ParseOptions {});
+    add(result, "toJson", measureWrite<joml::JsonWriter>((*doc).root(), runs));
+    add(result, "toJoml", measureWrite<joml::JomlWriter>((*doc).root(), runs));
+    return joml::Node(std::move(result));
+}
+
+int main(int argc, char** argv)
+{
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    size_t sizeMiB = 8;
+    size_t runs = 5;
+    std::vector<std::string> names;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if ((args[i] == "--size" || args[i] == "--runs") && i + 1 < args.size()) {
+            const auto value = std::strtoull(args[i + 1].c_str(), nullptr, 10);
+            (args[i] == "--size" ? sizeMiB : runs) = std::max<size_t>(value, 1);
+            i++;
+        } else {
+            names.push_back(args[i]);
+        }
+    }
+    if (names.empty()) {
+        for (const auto& [name, generator] : generators) {
+            names.push_back(name);
+        }
+    }
+
+    joml::Node::Array corpora;
+    for (const auto& name : names) {
+        const auto corpus = loadCorpus(name, sizeMiB * 1024 * 1024);
+        if (!corpus) {
+            std::cerr << "Could not read " << name << std::endl;
+            return 1;
+        }
+        auto result = benchmark(*corpus, runs);
+        if (!result) {
+            return 2;
+        }
+        corpora.push_back(std::move(*result));
+    }
+
+    joml::Node::Dictionary output;
+    add(output, "sizeMiB", integer(sizeMiB));
+    add(output, "runs", integer(runs));
+    add(output, "corpora", joml::Node(std::move(corpora)));
+    joml::FileSink sink(stdout);
+    joml::JsonWriter writer(sink);
+    const auto ok = writer.write(joml::Node(std::move(output))) && std::fputc('\n', stdout) != EOF;
+    return ok ? 0 : 1;
+}
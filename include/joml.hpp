@@ -1,7 +1,17 @@
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iosfwd>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <memory_resource>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -24,36 +34,311 @@ namespace utf8 {
     std::string_view readCodePoint(std::string_view str, size_t& cursor);
 }
 
+// Either owns its characters, which are allocated from a memory resource, or refers to characters
+// that are kept alive by someone else, like the source buffer of a zero-copy parse. Strings of up
+// to maxInlineSize bytes are always stored inline instead. Copies always own their characters and
+// use the default resource. A String takes 16 bytes, the last of which is left to Node.
+class String {
+public:
+    static constexpr size_t maxInlineSize = 14;
+
+    String() : mode_(0) { }
+
+    explicit String(std::string_view str,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    {
+        if (str.size() <= maxInlineSize) {
+            setInline(str);
+            return;
+        }
+        // The resource is stored in front of the characters, so it does not take up any space here
+        const auto block = static_cast<char*>(
+            resource->allocate(sizeof(resource) + str.size(), alignof(std::pmr::memory_resource*)));
+        std::memcpy(block, &resource, sizeof(resource));
+        std::memcpy(block + sizeof(resource), str.data(), str.size());
+        setOutOfLine(block + sizeof(resource), str.size(), owned);
+    }
+
+    String(const String& other) : String(std::string_view(other)) { }
+
+    String(String&& other) noexcept : mode_(other.mode_)
+    {
+        std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+        other.mode_ = 0;
+    }
+
+    ~String()
+    {
+        if (mode_ == owned) {
+            const auto block = const_cast<char*>(data()) - sizeof(std::pmr::memory_resource*);
+            std::pmr::memory_resource* resource;
+            std::memcpy(&resource, block, sizeof(resource));
+            resource->deallocate(block, sizeof(resource) + size(), alignof(decltype(resource)));
+        }
+    }
+
+    String& operator=(String other) noexcept
+    {
+        this->~String();
+        return *new (this) String(std::move(other));
+    }
+
+    // The returned string does not own str, so the caller has to keep it alive (unless it is
+    // short enough to be stored inline).
+    static String reference(std::string_view str)
+    {
+        String ret;
+        if (str.size() <= maxInlineSize) {
+            ret.setInline(str);
+        } else {
+            ret.setOutOfLine(str.data(), str.size(), referenced);
+        }
+        return ret;
+    }
+
+    const char* data() const
+    {
+        if (mode_ <= maxInlineSize) {
+            return bytes_;
+        }
+        const char* data;
+        std::memcpy(&data, bytes_, sizeof(data));
+        return data;
+    }
+
+    size_t size() const
+    {
+        if (mode_ <= maxInlineSize) {
+            return mode_;
+        }
+        uint32_t low;
+        uint16_t high;
+        std::memcpy(&low, bytes_ + sizeOffset, sizeof(low));
+        std::memcpy(&high, bytes_ + sizeOffset + sizeof(low), sizeof(high));
+        return static_cast<size_t>((uint64_t(high) << 32) | low);
+    }
+
+    bool empty() const { return size() == 0; }
+    const char* begin() const { return data(); }
+    const char* end() const { return data() + size(); }
+    char operator[](size_t idx) const { return data()[idx]; }
+
+    operator std::string_view() const { return std::string_view(data(), size()); }
+    // Lets code that got a std::string from a node before keep working, at the cost of a copy
+    operator std::string() const { return std::string(data(), size()); }
+
+    friend bool operator==(const String& a, const String& b)
+    {
+        return std::string_view(a) == std::string_view(b);
+    }
+    friend bool operator==(const String& a, std::string_view b) { return std::string_view(a) == b; }
+    friend bool operator==(std::string_view a, const String& b) { return a == std::string_view(b); }
+    friend bool operator!=(const String& a, const String& b) { return !(a == b); }
+    friend bool operator!=(const String& a, std::string_view b) { return !(a == b); }
+    friend bool operator!=(std::string_view a, const String& b) { return !(a == b); }
+
+    // Concatenation like with std::string, whose operator+ templates don't consider conversions
+    friend std::string operator+(const String& a, const String& b) { return concat(a, b); }
+    friend std::string operator+(const String& a, std::string_view b) { return concat(a, b); }
+    friend std::string operator+(std::string_view a, const String& b) { return concat(a, b); }
+
+private:
+    static std::string concat(std::string_view a, std::string_view b)
+    {
+        std::string ret;
+        ret.reserve(a.size() + b.size());
+        return ret.append(a).append(b);
+    }
+
+    // mode_ is the size of an inline string, or one of these
+    static constexpr uint8_t owned = 0x40;
+    static constexpr uint8_t referenced = 0x80;
+    static constexpr size_t sizeOffset = 8; // of the 48-bit size of a string that is not inline
+
+    void setInline(std::string_view str)
+    {
+        if (!str.empty()) {
+            std::memcpy(bytes_, str.data(), str.size());
+        }
+        mode_ = static_cast<uint8_t>(str.size());
+    }
+
+    void setOutOfLine(const char* data, size_t size, uint8_t mode)
+    {
+        const auto low = static_cast<uint32_t>(size);
+        const auto high = static_cast<uint16_t>(uint64_t(size) >> 32);
+        std::memcpy(bytes_, &data, sizeof(data));
+        std::memcpy(bytes_ + sizeOffset, &low, sizeof(low));
+        std::memcpy(bytes_ + sizeOffset + sizeof(low), &high, sizeof(high));
+        mode_ = mode;
+    }
+
+    // The characters of an inline string, otherwise a pointer to them and their size
+    alignas(8) char bytes_[maxInlineSize];
+    uint8_t mode_;
+    // Never touched by String, Node keeps its type tag here
+    [[maybe_unused]] uint8_t spare_;
+};
+
+std::ostream& operator<<(std::ostream& os, const String& str);
+
+// A dictionary key with a precomputed hash. Keep these around for keys that are looked up often,
+// so they don't have to be hashed again for every lookup.
+class Key {
+public:
+    constexpr Key(std::string_view str) : str_(str), hash_(hash(str)) { }
+
+    constexpr std::string_view string() const { return str_; }
+    constexpr uint64_t hash() const { return hash_; }
+
+    // FNV-1a
+    static constexpr uint64_t hash(std::string_view str)
+    {
+        uint64_t h = 0xcbf29ce484222325;
+        for (const auto ch : str) {
+            h = (h ^ static_cast<uint8_t>(ch)) * 0x100000001b3;
+        }
+        return h;
+    }
+
+private:
+    std::string_view str_;
+    uint64_t hash_;
+};
+
 class Node {
 public:
     struct Invalid { };
     struct Null { };
-    using String = std::string;
+    // All strings and containers take a memory resource, so a parse can place a whole tree in a
+    // single arena (see Document). Copies of nodes always allocate from the default resource.
+    using String = joml::String;
     using Bool = bool;
     using Integer = int64_t;
     using Float = double;
-    using Array = std::vector<Node>;
-    using Dictionary = std::vector<std::pair<std::string, Node>>;
+    using Array = std::pmr::vector<Node>;
+
+    // Keeps the entries in source order. Once a dictionary with at least indexThreshold entries is
+    // put into a Node, it gets a hash index (allocated from the same resource as the entries).
+    // Copies of a dictionary do not have an index until they are put into a Node themselves.
+    class Dictionary : public std::pmr::vector<std::pair<String, Node>> {
+    public:
+        static constexpr size_t indexThreshold = 16;
+
+        using vector::vector;
+
+        Dictionary(const Dictionary& other) : vector(other) { }
+        Dictionary(Dictionary&& other) noexcept
+            : vector(std::move(other))
+            , index_(std::exchange(other.index_, nullptr))
+            , indexSize_(std::exchange(other.indexSize_, 0))
+        {
+        }
+        ~Dictionary() { dropIndex(); }
+
+        // Nodes can not be assigned, so neither can containers of them
+        Dictionary& operator=(const Dictionary&) = delete;
+
+        // Returns the value of the first entry with the given key or nullptr if there is none
+        const Node* find(std::string_view key) const;
+        const Node* find(const Key& key) const;
+
+        bool hasIndex() const { return index_ != nullptr; }
+
+    private:
+        friend class Node;
+
+        struct Slot {
+            uint32_t entry; // index + 1, so 0 is an empty slot
+            uint32_t hash; // upper bits of the key hash
+        };
+
+        void buildIndex();
+        void dropIndex();
+
+        Slot* index_ = nullptr;
+        size_t indexSize_ = 0; // always a power of two
+    };
+
+    Node() { setTag(Tag::Invalid); }
+    Node(Null) { setTag(Tag::Null); }
+    Node(String v) { construct(string_, std::move(v), Tag::String); }
+    // Copies str into a String of the default resource, e.g. to make a node of a std::string
+    Node(std::string_view str) : Node(String(str)) { }
+    Node(Bool v) { construct(bool_, v, Tag::Bool); }
+    Node(Integer v) { construct(integer_, v, Tag::Integer); }
+    Node(Float v) { construct(float_, v, Tag::Float); }
+    Node(Array v) { construct(array_, allocate(std::move(v)), Tag::Array); }
+    Node(Dictionary v)
+    {
+        construct(dictionary_, allocate(std::move(v)), Tag::Dictionary);
+        dictionary_->buildIndex();
+    }
+
+    Node(Node&& other) noexcept
+    {
+        switch (other.tag()) {
+        case Tag::String:
+            construct(string_, std::move(other.string_), Tag::String);
+            other.string_.~String();
+            break;
+        case Tag::Array:
+            construct(array_, other.array_, Tag::Array);
+            break;
+        case Tag::Dictionary:
+            construct(dictionary_, other.dictionary_, Tag::Dictionary);
+            break;
+        default:
+            // The other values are trivial, they can be copied as they are
+            std::memcpy(static_cast<void*>(this), &other, sizeof(Node));
+            break;
+        }
+        other.setTag(Tag::Invalid);
+    }
 
-    Node() : data_(Invalid {}) { }
-    Node(Null v) : data_(std::move(v)) { }
-    Node(String v) : data_(std::move(v)) { }
-    Node(Bool v) : data_(v) { }
-    Node(Integer v) : data_(v) { }
-    Node(Float v) : data_(v) { }
-    Node(Array v) : data_(std::move(v)) { }
-    Node(Dictionary v) : data_(std::move(v)) { }
+    Node(const Node& other)
+    {
+        switch (other.tag()) {
+        case Tag::String:
+            construct(string_, String(other.string_), Tag::String);
+            break;
+        case Tag::Array:
+            construct(array_, allocate(Array(*other.array_)), Tag::Array);
+            break;
+        case Tag::Dictionary:
+            construct(dictionary_, allocate(Dictionary(*other.dictionary_)), Tag::Dictionary);
+            dictionary_->buildIndex();
+            break;
+        default:
+            std::memcpy(static_cast<void*>(this), &other, sizeof(Node));
+            break;
+        }
+    }
 
-    Node(Node&&) = default;
-    Node(const Node&) = default;
+    ~Node()
+    {
+        switch (tag()) {
+        case Tag::String:
+            string_.~String();
+            break;
+        case Tag::Array:
+            deallocate(array_);
+            break;
+        case Tag::Dictionary:
+            deallocate(dictionary_);
+            break;
+        default:
+            break;
+        }
+    }
 
     template <typename T>
     bool is() const
     {
         if constexpr (std::is_same_v<T, Float>) {
-            return std::holds_alternative<Float>(data_) || std::holds_alternative<Integer>(data_);
+            return tag() == Tag::Float || tag() == Tag::Integer;
         }
-        return std::holds_alternative<T>(data_);
+        return tag() == tagOf<T>();
     }
 
     bool isValid() const { return !is<Invalid>(); }
@@ -65,12 +350,31 @@ public:
     bool isArray() const { return is<Array>(); }
     bool isDictionary() const { return is<Dictionary>(); }
 
-    operator bool() const { return isValid(); }
+    explicit operator bool() const { return isValid(); }
 
+    // Throws std::bad_variant_access for values of another type, floats included for integers
     template <typename T>
     const T& as() const
     {
-        return std::get<T>(data_);
+        if (tag() != tagOf<T>()) {
+            throw std::bad_variant_access();
+        }
+        if constexpr (std::is_same_v<T, String>) {
+            return string_;
+        } else if constexpr (std::is_same_v<T, Bool>) {
+            return bool_;
+        } else if constexpr (std::is_same_v<T, Integer>) {
+            return integer_;
+        } else if constexpr (std::is_same_v<T, Float>) {
+            return float_;
+        } else if constexpr (std::is_same_v<T, Array>) {
+            return *array_;
+        } else if constexpr (std::is_same_v<T, Dictionary>) {
+            return *dictionary_;
+        } else {
+            static const T value {};
+            return value;
+        }
     }
 
     const String& asString() const { return as<String>(); }
@@ -96,10 +400,18 @@ public:
     const Node& operator[](std::string_view key) const
     {
         if (isDictionary()) {
-            for (const auto& [k, v] : asDictionary()) {
-                if (k == key) {
-                    return v;
-                }
+            if (const auto node = asDictionary().find(key)) {
+                return *node;
+            }
+        }
+        return getInvalidNode();
+    }
+
+    const Node& operator[](const Key& key) const
+    {
+        if (isDictionary()) {
+            if (const auto node = asDictionary().find(key)) {
+                return *node;
             }
         }
         return getInvalidNode();
@@ -113,14 +425,87 @@ public:
         return getInvalidNode();
     }
 
+    // Deep comparison without recursion. Integers never equal floats, floats compare by value
+    // except that NaN equals NaN, and dictionary entries are compared in order.
+    friend bool operator==(const Node& a, const Node& b);
+    friend bool operator!=(const Node& a, const Node& b) { return !(a == b); }
+
 private:
+    enum class Tag : uint8_t { Invalid, Null, String, Bool, Integer, Float, Array, Dictionary };
+
+    template <typename T>
+    static constexpr Tag tagOf()
+    {
+        if constexpr (std::is_same_v<T, Invalid>) {
+            return Tag::Invalid;
+        } else if constexpr (std::is_same_v<T, Null>) {
+            return Tag::Null;
+        } else if constexpr (std::is_same_v<T, String>) {
+            return Tag::String;
+        } else if constexpr (std::is_same_v<T, Bool>) {
+            return Tag::Bool;
+        } else if constexpr (std::is_same_v<T, Integer>) {
+            return Tag::Integer;
+        } else if constexpr (std::is_same_v<T, Float>) {
+            return Tag::Float;
+        } else if constexpr (std::is_same_v<T, Array>) {
+            return Tag::Array;
+        } else {
+            static_assert(std::is_same_v<T, Dictionary>, "not a type of node");
+            return Tag::Dictionary;
+        }
+    }
+
+    // The tag lives in the last byte, which is past the end of all other values and left unused
+    // by String
+    static constexpr size_t tagOffset = sizeof(String) - 1;
+
+    Tag tag() const { return static_cast<Tag>(reinterpret_cast<const uint8_t*>(this)[tagOffset]); }
+    void setTag(Tag tag)
+    {
+        reinterpret_cast<uint8_t*>(this)[tagOffset] = static_cast<uint8_t>(tag);
+    }
+
+    template <typename T, typename V>
+    void construct(T& member, V&& value, Tag tag)
+    {
+        new (&member) T(std::forward<V>(value));
+        setTag(tag);
+    }
+
+    // Containers are kept out of line, in the resource they allocate their elements from
+    template <typename T>
+    static T* allocate(T&& container)
+    {
+        const auto resource = container.get_allocator().resource();
+        return new (resource->allocate(sizeof(T), alignof(T))) T(std::move(container));
+    }
+
+    template <typename T>
+    static void deallocate(T* container)
+    {
+        const auto resource = container->get_allocator().resource();
+        container->~T();
+        resource->deallocate(container, sizeof(T), alignof(T));
+    }
+
+    friend class Path;
+    friend class PathSet;
+
     static const Node& getInvalidNode()
     {
         static Node node;
         return node;
     }
 
-    std::variant<Invalid, Null, String, Bool, Integer, Float, Array, Dictionary> data_;
+    union {
+        String string_;
+        Bool bool_;
+        Integer integer_;
+        Float float_;
+        Array* array_;
+        Dictionary* dictionary_;
+    };
 };
 
 struct Position {
@@ -146,10 +531,17 @@ struct ParseError {
         ExpectedColon,
         UnterminatedString,
         InvalidEscape,
+        Aborted, // by a Handler
+        CouldNotReadFile, // in parseFile
+        InvalidBinary, // in loadBinary
+        OutdatedBinary, // in loadBinary
+        TypeMismatch, // in parseInto
+        InvalidPath, // in Path::compile
     };
 
     Type type;
     Position position;
+    size_t offset = 0; // of the error in the source in bytes
 
     std::string string() const;
 };
@@ -178,8 +570,1022 @@ struct ParseResult {
     T& operator*() { return std::get<T>(result); }
 };
 
+// What a parse went through, e.g. to find out which documents are expensive to load
+struct ParseStats {
+    size_t bytes = 0; // of the source
+    // Nodes of each type, including the root dictionary
+    size_t nulls = 0;
+    size_t bools = 0;
+    size_t integers = 0;
+    size_t floats = 0;
+    size_t strings = 0;
+    size_t arrays = 0;
+    size_t dictionaries = 0;
+    size_t keys = 0;
+    size_t maxDepth = 0; // of nested containers, the root dictionary has a depth of 1
+    size_t stringBytesCopied = 0; // of keys and strings that do not refer to the source
+    size_t escapesDecoded = 0;
+    // Allocations from the arena of the document, which never allocates anything else
+    size_t allocations = 0;
+    size_t allocatedBytes = 0;
+};
+
+// Stores every distinct key once, for documents whose dictionaries share the same keys. Keys of up
+// to String::maxInlineSize bytes are stored in every entry anyway, so only longer ones are
+// interned, after which equal keys share their characters and compare by pointer. A table can be
+// shared by parses on any number of threads and has to outlive the documents parsed with it.
+class KeyTable {
+public:
+    explicit KeyTable(std::pmr::memory_resource* upstream = nullptr);
+    ~KeyTable();
+
+    // Returns the interned copy of key, e.g. for lookups in dictionaries parsed with the table
+    std::string_view intern(std::string_view key);
+
+    // Number of distinct keys
+    size_t size() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+class PathSet;
+
+struct ParseOptions {
+    // Size of the first block of the document arena. 0 means it is estimated from the source size.
+    size_t arenaSize = 0;
+    // The resource the arena allocates its blocks from. nullptr means the default resource.
+    std::pmr::memory_resource* upstream = nullptr;
+    // Keys and strings without escape sequences refer to the source instead of being copied, so
+    // the source has to outlive the document (or be passed to parse as a shared_ptr).
+    bool zeroCopy = false;
+    // Documents of at least a MiB are split into ranges of root dictionary entries, which are
+    // parsed on up to this many threads (0 means one per hardware thread). The result is the same
+    // as that of a serial parse. upstream has to be thread-safe if this is not 1.
+    size_t numThreads = 1;
+    // Stores every distinct key that is too long to be inline once per document, see KeyTable
+    bool internKeys = false;
+    // Interns keys in this table instead, which can be shared by any number of documents
+    KeyTable* keyTable = nullptr;
+    // Keeps the source range of every node, so reparse can update the document after an edit by
+    // only parsing the affected part. The root dictionary is then never parsed in parallel.
+    bool recordSpans = false;
+    // Only builds the nodes on the way to the matches of these paths and below them and skips all
+    // other values. Skipped array elements are left as invalid nodes, so indices stay the same.
+    // Negative indices and slice bounds depend on the size of the array, so they select every
+    // element. The set has to outlive the parse, but is not kept by the document (reparse parses
+    // it in full). The parse is serial, recordSpans is ignored and loadOrParse neither reads nor
+    // writes the binary file.
+    const PathSet* projection = nullptr;
+    // Skips values outside of the projection by only matching brackets and quotes. Otherwise they
+    // are parsed without building anything, so errors in them are reported like in a full parse.
+    bool trustedInput = false;
+    // Receives the statistics of the parse, which makes it slightly slower. parseBatch,
+    // parseFileBatch, parseFile of a file that can not be mapped and loadBinary (so loadOrParse
+    // when it uses the binary file) do not fill it in.
+    ParseStats* stats = nullptr;
+};
+
+#ifdef JOML_TRACING
+// Tracing builds (JOML_ENABLE_TRACING in CMake, the tracing option in meson) time the functions of
+// the parser and call the hook whenever one of them returns, with the time spent in it including
+// the functions it called. The hook is called on the parsing thread. Other builds do not contain
+// any of this.
+using TraceHook = void (*)(const char* function, uint64_t nanoseconds);
+void setTraceHook(TraceHook hook);
+#endif
+
+// The bytes [begin, end) of a source were replaced with text
+struct Edit {
+    size_t begin;
+    size_t end;
+    std::string_view text;
+};
+
+// Owns a monotonic arena that every node, key and string of a parse is allocated from.
+// Destroying a Document releases the arena in one go without walking the tree.
+class Document {
+public:
+    Document(Document&&) noexcept;
+    Document& operator=(Document&&) noexcept;
+    ~Document();
+
+    const Node& root() const { return *root_; }
+    const Node& operator[](std::string_view key) const { return (*root_)[key]; }
+    const Node& operator[](const Key& key) const { return (*root_)[key]; }
+
+private:
+    friend ParseResult<Document> parse(std::string_view str, const ParseOptions& options);
+    friend ParseResult<Document> parse(
+        std::shared_ptr<const std::string> source, const ParseOptions& options);
+    friend ParseResult<Document> parseFile(const std::string& path, const ParseOptions& options);
+    friend ParseResult<Document> loadBinary(const std::string& path, const ParseOptions& options,
+        std::optional<uint64_t> sourceHash);
+    friend ParseResult<Document> loadOrParse(
+        const std::string& path, const std::string& cachePath, const ParseOptions& options);
+    friend class DocumentBuilder;
+    friend std::optional<ParseError> reparse(
+        Document& doc, const Edit& edit, std::string_view newSource);
+
+    // The source ranges of the elements of every container, see ParseOptions::recordSpans
+    struct Spans;
+
+    Document(std::unique_ptr<std::pmr::monotonic_buffer_resource> arena, const Node* root);
+
+    ParseOptions options_; // without stats
+    std::unique_ptr<Spans> spans_;
+    std::shared_ptr<const void> source_; // only set if the document keeps its source alive
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+    // The entries of a root dictionary that was parsed in parallel live in one arena per chunk
+    std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> chunkArenas_;
+    const Node* root_; // lives in arena_ and is never destroyed
+};
+
+// The entries of a TapeDocument: a tag in the upper 8 bits and a payload in the rest
+enum class TapeTag : uint8_t {
+    Null,
+    True,
+    False,
+    Integer, // followed by an entry with the value
+    Float, // followed by an entry with the bits of the value
+    String, // payload: offset in the string buffer, followed by an entry with the size
+    Key, // like String, followed by the value
+    ArrayStart, // payload: distance to ArrayEnd
+    ArrayEnd, // payload: number of elements
+    DictionaryStart, // payload: distance to DictionaryEnd
+    DictionaryEnd, // payload: number of entries
+};
+
+// A cheap handle to a value in a TapeDocument with the same interface as Node, except that strings
+// are returned as views and containers as ranges of views. Invalid views are default-constructed.
+// Lookups by key or index are linear scans, so iterate over big containers instead.
+class NodeView {
+public:
+    static constexpr unsigned tagShift = 56;
+    static constexpr uint64_t payloadMask = (uint64_t(1) << tagShift) - 1;
+
+    template <bool IsDictionary>
+    class ContainerView;
+    using ArrayView = ContainerView<false>;
+    using DictionaryView = ContainerView<true>;
+
+    NodeView() = default;
+    NodeView(const uint64_t* entry, const char* strings) : entry_(entry), strings_(strings) { }
+
+    bool isValid() const { return entry_ != nullptr; }
+    bool isNull() const { return is(TapeTag::Null); }
+    bool isString() const { return is(TapeTag::String); }
+    bool isBool() const { return is(TapeTag::True) || is(TapeTag::False); }
+    bool isInteger() const { return is(TapeTag::Integer); }
+    bool isFloat() const { return is(TapeTag::Float) || is(TapeTag::Integer); }
+    bool isArray() const { return is(TapeTag::ArrayStart); }
+    bool isDictionary() const { return is(TapeTag::DictionaryStart); }
+
+    explicit operator bool() const { return isValid(); }
+
+    // Like Node, these throw std::bad_variant_access for values of another type
+    std::string_view asString() const
+    {
+        check(isString());
+        return string(entry_);
+    }
+
+    Node::Bool asBool() const
+    {
+        check(isBool());
+        return is(TapeTag::True);
+    }
+
+    Node::Integer asInteger() const
+    {
+        check(isInteger());
+        return static_cast<Node::Integer>(entry_[1]);
+    }
+
+    // Integers are converted
+    Node::Float asFloat() const
+    {
+        check(isFloat());
+        if (isInteger()) {
+            return static_cast<Node::Float>(asInteger());
+        }
+        Node::Float v;
+        std::memcpy(&v, &entry_[1], sizeof(v));
+        return v;
+    }
+
+    ArrayView asArray() const;
+    DictionaryView asDictionary() const;
+
+    size_t size() const
+    {
+        if (isInteger() || isFloat() || isString() || isBool()) {
+            return 1;
+        } else if (isArray() || isDictionary()) {
+            return entry_[payload()] & payloadMask;
+        } else {
+            return 0;
+        }
+    }
+
+    NodeView operator[](std::string_view key) const;
+    NodeView operator[](const Key& key) const { return (*this)[key.string()]; }
+    NodeView operator[](size_t idx) const;
+
+private:
+    TapeTag tag() const { return static_cast<TapeTag>(*entry_ >> tagShift); }
+    uint64_t payload() const { return *entry_ & payloadMask; }
+    bool is(TapeTag tag) const { return entry_ && this->tag() == tag; }
+
+    static void check(bool ok)
+    {
+        if (!ok) {
+            throw std::bad_variant_access();
+        }
+    }
+
+    // Of a String or Key entry
+    std::string_view string(const uint64_t* entry) const
+    {
+        return std::string_view(strings_ + (*entry & payloadMask), entry[1]);
+    }
+
+    // The entry after this value
+    const uint64_t* next() const
+    {
+        switch (tag()) {
+        case TapeTag::Integer:
+        case TapeTag::Float:
+        case TapeTag::String:
+            return entry_ + 2;
+        case TapeTag::ArrayStart:
+        case TapeTag::DictionaryStart:
+            return entry_ + payload() + 1;
+        default:
+            return entry_ + 1;
+        }
+    }
+
+    const uint64_t* entry_ = nullptr;
+    const char* strings_ = nullptr;
+};
+
+// The elements of an array or the entries (key and value) of a dictionary
+template <bool IsDictionary>
+class NodeView::ContainerView {
+public:
+    using value_type
+        = std::conditional_t<IsDictionary, std::pair<std::string_view, NodeView>, NodeView>;
+
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = ContainerView::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        iterator(const uint64_t* entry, const char* strings) : entry_(entry), strings_(strings) { }
+
+        value_type operator*() const
+        {
+            if constexpr (IsDictionary) {
+                const NodeView key(entry_, strings_);
+                return { key.string(entry_), NodeView(entry_ + 2, strings_) };
+            } else {
+                return NodeView(entry_, strings_);
+            }
+        }
+
+        iterator& operator++()
+        {
+            entry_ = NodeView(IsDictionary ? entry_ + 2 : entry_, strings_).next();
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const iterator& other) const { return entry_ == other.entry_; }
+        bool operator!=(const iterator& other) const { return entry_ != other.entry_; }
+
+    private:
+        const uint64_t* entry_;
+        const char* strings_;
+    };
+
+    ContainerView(const uint64_t* start, const char* strings) : start_(start), strings_(strings) { }
+
+    iterator begin() const { return iterator(start_ + 1, strings_); }
+    iterator end() const { return iterator(start_ + (*start_ & payloadMask), strings_); }
+    size_t size() const { return start_[*start_ & payloadMask] & payloadMask; }
+    bool empty() const { return size() == 0; }
+
+private:
+    const uint64_t* start_;
+    const char* strings_;
+};
+
+inline NodeView::ArrayView NodeView::asArray() const
+{
+    check(isArray());
+    return ArrayView(entry_, strings_);
+}
+
+inline NodeView::DictionaryView NodeView::asDictionary() const
+{
+    check(isDictionary());
+    return DictionaryView(entry_, strings_);
+}
+
+inline NodeView NodeView::operator[](std::string_view key) const
+{
+    if (isDictionary()) {
+        for (const auto& [k, v] : asDictionary()) {
+            if (k == key) {
+                return v;
+            }
+        }
+    }
+    return NodeView();
+}
+
+inline NodeView NodeView::operator[](size_t idx) const
+{
+    if (isArray() && idx < size()) {
+        auto it = asArray().begin();
+        for (size_t i = 0; i < idx; ++i) {
+            ++it;
+        }
+        return *it;
+    }
+    return NodeView();
+}
+
+// An alternative to Document: one contiguous tape of entries (see TapeTag) and one buffer with all
+// strings. Full traversals walk memory in order and destruction is two deallocations. Views stay
+// valid when the document is moved.
+class TapeDocument {
+public:
+    NodeView root() const { return NodeView(tape_.data(), strings_.data()); }
+    NodeView operator[](std::string_view key) const { return root()[key]; }
+    NodeView operator[](const Key& key) const { return root()[key]; }
+
+private:
+    friend ParseResult<TapeDocument> parseTape(std::string_view str);
+
+    std::vector<uint64_t> tape_;
+    std::vector<char> strings_; // every string is null-terminated
+};
+
+// Receives the events of a parse, which never builds a tree. The root dictionary is reported like
+// any other. Every event returns whether the parse should continue. String views are only valid
+// for the duration of the call.
+class Handler {
+public:
+    virtual ~Handler() = default;
+
+    virtual bool null() { return true; }
+    virtual bool boolean(Node::Bool) { return true; }
+    virtual bool integer(Node::Integer) { return true; }
+    virtual bool floating(Node::Float) { return true; }
+    virtual bool string(std::string_view) { return true; }
+    virtual bool key(std::string_view) { return true; }
+    virtual bool startArray() { return true; }
+    virtual bool endArray() { return true; }
+    virtual bool startDictionary() { return true; }
+    virtual bool endDictionary() { return true; }
+};
+
+// Builds a Document from the events of a parse, e.g. one done by a PushParser. Strings are always
+// copied into the arena, so ParseOptions::zeroCopy has no effect.
+class DocumentBuilder : public Handler {
+public:
+    explicit DocumentBuilder(const ParseOptions& options = {});
+    ~DocumentBuilder() override;
+
+    bool null() override;
+    bool boolean(Node::Bool v) override;
+    bool integer(Node::Integer v) override;
+    bool floating(Node::Float v) override;
+    bool string(std::string_view str) override;
+    bool key(std::string_view str) override;
+    bool startArray() override;
+    bool endArray() override;
+    bool startDictionary() override;
+    bool endDictionary() override;
+
+    // May only be called once, after a successful parse
+    Document document();
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+// Parses a document that arrives in chunks, which may end anywhere. Every element that is known to
+// be complete is parsed as soon as it has been fed and only the rest is buffered, so apart from the
+// handler, memory use is bounded by the chunk size plus the longest key, string or number.
+class PushParser {
+public:
+    explicit PushParser(Handler& handler);
+    ~PushParser();
+
+    // Returns the first error in the document once the chunk containing it has been fed (or
+    // sometimes a later one). After an error, feed and finish keep returning it.
+    std::optional<ParseError> feed(std::string_view chunk);
+
+    // Has to be called after the last chunk
+    std::optional<ParseError> finish();
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+// Indexes the line starts of a source once, after which every lookup is a binary search. Keep one
+// around to resolve many offsets or to print the context of many errors in the same source.
+class SourceMap {
+public:
+    explicit SourceMap(std::string_view source);
+
+    Position position(size_t offset) const;
+
+    size_t lineCount() const { return lineStarts_.size(); }
+    // Without the newline, line numbers start at 1
+    std::string_view line(size_t line) const;
+
+    // The lines around position and a caret that points at its column
+    std::string context(const Position& position, size_t numContextLines = 1) const;
+
+private:
+    std::string_view source_;
+    std::vector<size_t> lineStarts_;
+};
+
+// Builds a SourceMap for a single call
 std::string getContextString(std::string_view str, const Position& position);
 
+// Returns an error of type Aborted if the handler stopped the parse
+std::optional<ParseError> parse(std::string_view str, Handler& handler);
+
+// Compatibility layer: the result allocates from the default resource.
 ParseResult<Node::Dictionary> parse(std::string_view str);
 
+ParseResult<Document> parse(std::string_view str, const ParseOptions& options);
+
+// The document keeps source alive, which makes it safe to use with ParseOptions::zeroCopy.
+ParseResult<Document> parse(std::shared_ptr<const std::string> source, const ParseOptions& options);
+
+// Updates a document after edit turned its source into newSource. If the document was parsed with
+// ParseOptions::recordSpans, only the smallest run of elements around the edit is parsed again and
+// their values are replaced. If the run parses differently in the context of its container (e.g.
+// because the edit closed it), it is widened to the parent container, but only a few times before
+// falling back to a full parse, so a reparse costs at most a few full parses. An edit that makes
+// the source invalid falls back to a full parse right away, which reports the error. Documents
+// without spans and those parsed with zeroCopy are always parsed again in full with the options
+// they were parsed with. zeroCopy documents then keep a copy of newSource alive, so it only has
+// to outlive the call. On error the document is left unchanged.
+std::optional<ParseError> reparse(Document& doc, const Edit& edit, std::string_view newSource);
+
+ParseResult<TapeDocument> parseTape(std::string_view str);
+
+// Parses straight from a read-only memory mapping of the file, which the document keeps alive, so
+// this works with ParseOptions::zeroCopy. Files that can not be mapped, like pipes, are read in
+// chunks and fed to a PushParser instead, in which case strings are always copied.
+ParseResult<Document> parseFile(const std::string& path, const ParseOptions& options = {});
+
+// Parse many inputs on up to numThreads threads (0 means one per hardware thread) and return the
+// results in input order. Every thread reuses its parser state from one input to the next.
+std::vector<ParseResult<Document>> parseBatch(const std::vector<std::string_view>& sources,
+    const ParseOptions& options = {}, size_t numThreads = 0);
+std::vector<ParseResult<Document>> parseFileBatch(const std::vector<std::string>& paths,
+    const ParseOptions& options = {}, size_t numThreads = 0);
+
+// A compact binary serialization of a tree, which can be loaded without any text parsing. It is
+// versioned and carries a hash of the source the tree was parsed from, so outdated caches can be
+// detected. Hashes depend on the byte order, so caches should be written where they are used.
+uint64_t hashSource(std::string_view source);
+
+std::string toBinary(const Node::Dictionary& root, uint64_t sourceHash);
+
+// Replaces the file atomically, so readers never see a partially written cache. Returns false if
+// it could not be written.
+bool writeBinaryFile(const std::string& path, const Node::Dictionary& root, uint64_t sourceHash);
+
+// Maps the file and builds the tree straight from it. Strings refer to the mapping, which the
+// document keeps alive. Of the options, the arena ones and the key interning ones are used and
+// the rest is kept for reparse. Returns InvalidBinary if the file is corrupt or of another format
+// version and OutdatedBinary if sourceHash is given and does not match the hash in the file.
+ParseResult<Document> loadBinary(const std::string& path, const ParseOptions& options = {},
+    std::optional<uint64_t> sourceHash = std::nullopt);
+
+// Loads the cache at cachePath if it was written for the current contents of the file at path.
+// Otherwise the file is parsed and the cache is rewritten (failing to write it is not an error).
+// The cache is not used with ParseOptions::projection or recordSpans, which it can not honor, and
+// stats are not filled in when it is.
+ParseResult<Document> loadOrParse(
+    const std::string& path, const std::string& cachePath, const ParseOptions& options = {});
+
+// Receives the output of a writer in large chunks
+class Sink {
+public:
+    virtual ~Sink() = default;
+
+    // Returns false if the data could not be written
+    virtual bool write(std::string_view data) = 0;
+};
+
+// Appends to a string, which can be cleared and reused for the next output
+class StringSink : public Sink {
+public:
+    explicit StringSink(std::string& str) : str_(str) { }
+
+    bool write(std::string_view data) override
+    {
+        str_.append(data);
+        return true;
+    }
+
+private:
+    std::string& str_;
+};
+
+class FileSink : public Sink {
+public:
+    explicit FileSink(FILE* file) : file_(file) { }
+
+    bool write(std::string_view data) override;
+
+private:
+    FILE* file_;
+};
+
+// Writes to a file descriptor without any buffering of its own
+class FdSink : public Sink {
+public:
+    explicit FdSink(int fd) : fd_(fd) { }
+
+    bool write(std::string_view data) override;
+
+private:
+    int fd_;
+};
+
+// Streams a tree as JSON through a buffer that is reused from one write to the next, without any
+// strings per node. Pretty output is indented by 4 spaces per level, compact output has no
+// whitespace at all. Floats are written as the shortest representation that round-trips and
+// non-finite ones as NaN, Infinity and -Infinity, like JavaScript does.
+class JsonWriter {
+public:
+    explicit JsonWriter(Sink& sink, bool pretty = true);
+
+    // Writes node and flushes the buffer. Returns false if the sink failed.
+    bool write(const Node& node);
+
+private:
+    struct Container {
+        const Node::Array* array; // exactly one of these is set
+        const Node::Dictionary* dictionary;
+        size_t next; // index of the next element
+    };
+
+    void open(const Node& node);
+    void close();
+    void string(std::string_view str);
+    void newline(size_t depth);
+    void flushIfFull();
+
+    Sink& sink_;
+    bool pretty_;
+    bool ok_ = true;
+    std::string buffer_;
+    std::vector<Container> open_;
+};
+
+// Streams a tree as JOML, which parses back into the same tree. A dictionary is written as a
+// document (its entries without braces), anything else as a single value. Containers are indented
+// by 4 spaces per level with one element per line, keys are only quoted if they could not be read
+// back otherwise and floats are written as the shortest representation that round-trips.
+class JomlWriter {
+public:
+    explicit JomlWriter(Sink& sink);
+
+    // Writes node and flushes the buffer. Returns false if the sink failed.
+    bool write(const Node& node);
+
+private:
+    struct Container {
+        const Node::Array* array; // exactly one of these is set
+        const Node::Dictionary* dictionary;
+        size_t next; // index of the next element
+    };
+
+    void open(const Node& node);
+    void close();
+    void key(std::string_view key);
+    void string(std::string_view str);
+    void newline(size_t depth);
+    void flushIfFull();
+
+    Sink& sink_;
+    bool ok_ = true;
+    bool document_ = false; // whether the bottom of open_ is the root of a document
+    std::string buffer_;
+    std::vector<Container> open_;
+};
+
+// Writes node with a JomlWriter
+bool write(const Node& node, Sink& sink);
+
+// A dictionary key or an array index on the way from the root of a tree to one of its nodes
+using PathElement = std::variant<std::string_view, size_t>;
+
+struct Change {
+    enum class Type {
+        Added,
+        Removed,
+        Modified,
+    };
+
+    Type type;
+    std::vector<PathElement> path; // keys refer to the trees
+    const Node* oldValue; // nullptr if added
+    const Node* newValue; // nullptr if removed
+};
+
+// Structural hashes of every node of a tree in pre-order, computed in one pass without recursion.
+// Equal subtrees have equal hashes (which diff relies on, it does not compare them), so keeping the
+// hashes of a tree around lets it be diffed against several others without hashing it again. The
+// tree must not change while they are used.
+class NodeHashes {
+public:
+    explicit NodeHashes(const Node& root);
+
+    const Node& root() const { return *root_; }
+    uint64_t hash() const { return entries_[0].hash; }
+
+private:
+    friend std::vector<Change> diff(const NodeHashes& a, const NodeHashes& b);
+
+    struct Entry {
+        uint64_t hash;
+        size_t size; // number of nodes in the subtree
+    };
+
+    const Node* root_;
+    std::vector<Entry> entries_;
+};
+
+// Lists the changes from a to b in pre-order. Subtrees with the same hash are skipped without
+// looking into them. Dictionary entries are matched by key, the n-th entry with a key in a to the
+// n-th one with that key in b, so reordering entries is not a change. Entries that were removed
+// from a dictionary come after the other changes in it. Array elements are matched by index and a
+// value that changes type is modified as a whole.
+std::vector<Change> diff(const NodeHashes& a, const NodeHashes& b);
+std::vector<Change> diff(const Node& a, const Node& b);
+
+namespace detail {
+    class Projection;
+
+    // Refers to a callable instead of holding it, so unlike std::function passing one never
+    // allocates. The callable returns whether to go on.
+    template <typename... Args>
+    class FunctionRef {
+    public:
+        template <typename F>
+        FunctionRef(F& f)
+            : object_(&f)
+            , call_([](void* object, Args... args) -> bool {
+                return (*static_cast<F*>(object))(args...);
+            })
+        {
+        }
+
+        bool operator()(Args... args) const { return call_(object_, args...); }
+
+    private:
+        void* object_;
+        bool (*call_)(void*, Args...);
+    };
+}
+
+// A query that is compiled once from a string like servers[3].listen.port and then evaluated
+// against trees without allocating. Keys are separated by dots and have to be quoted like "a.b" if
+// they contain whitespace or any of . [ ] * " (\" and \\ are the only escapes). Brackets hold an
+// index ([-1] is the last element), a slice of an array ([1:3], [2:] or [:-1]) or a quoted key.
+// * and [*] match every element of an array and every value of a dictionary. Keys are looked up
+// with precomputed hashes and match the first entry with that key. The empty path is the root.
+// Copies share the compiled steps.
+class Path {
+public:
+    Path() = default;
+
+    static ParseResult<Path> compile(std::string_view str);
+
+    std::string_view string() const;
+
+    // Whether the path matches at most one node, i.e. it has no wildcards or slices
+    bool isSingle() const;
+
+    // The first match in document order or an invalid node
+    const Node& get(const Node& root) const;
+
+    // Calls f with every match in document order
+    template <typename F>
+    void forEach(const Node& root, F&& f) const
+    {
+        auto each = [&f](const Node& node) {
+            f(node);
+            return true;
+        };
+        visit(root, 0, each);
+    }
+
+private:
+    friend class PathSet;
+    friend class detail::Projection;
+
+    struct Step;
+    struct Steps;
+
+    bool visit(const Node& node, size_t step, detail::FunctionRef<const Node&> f) const;
+
+    std::shared_ptr<const Steps> steps_; // nullptr for the root
+};
+
+// Evaluates many paths in a single traversal. The paths are kept in a trie, so the steps they have
+// in common are only taken once, e.g. all the settings of a section are looked up in the same
+// dictionary without getting to it again for each one.
+class PathSet {
+public:
+    PathSet() : nodes_(1) { }
+
+    // Returns the index that the matches of path are reported with
+    size_t add(Path path);
+
+    size_t size() const { return paths_.size(); }
+    const Path& operator[](size_t idx) const { return paths_[idx]; }
+
+    // Calls f(index, node) with every match of every path. The matches of each path are in
+    // document order, but those of different paths are interleaved.
+    template <typename F>
+    void evaluate(const Node& root, F&& f) const
+    {
+        auto each = [&f](size_t path, const Node& node) {
+            f(path, node);
+            return true;
+        };
+        visit(root, 0, each);
+    }
+
+    // The first match of each path in the order they were added (an invalid node if there is none)
+    std::vector<const Node*> get(const Node& root) const;
+
+private:
+    friend class detail::Projection;
+
+    struct TrieNode {
+        size_t path = 0; // which holds the step that leads here
+        size_t step = 0;
+        std::vector<size_t> children;
+        std::vector<size_t> ends; // paths that end here
+    };
+
+    void visit(const Node& node, size_t trieNode, detail::FunctionRef<size_t, const Node&> f) const;
+
+    std::vector<Path> paths_;
+    std::vector<TrieNode> nodes_; // the first one is the root
+};
+
+// Typed deserialization: describe a struct with JOML_FIELDS and parseInto fills it straight from
+// the parse events, without building a tree. Supported members are bool, integers (which have to
+// fit), floating point numbers, std::string, std::vector, std::optional (null resets it) and
+// structs with JOML_FIELDS. Fields that are missing from the source keep their value and unknown
+// keys are skipped. Values of the wrong type are reported as TypeMismatch at their position.
+namespace detail {
+    struct TargetOps;
+
+    // An object that is being parsed into. Values with a null target are skipped.
+    struct Target {
+        void* object = nullptr;
+        const TargetOps* ops = nullptr;
+    };
+
+    // Every operation is nullptr if the type can not be parsed from the corresponding value
+    struct TargetOps {
+        bool (*null)(void*) = nullptr;
+        bool (*boolean)(void*, Node::Bool) = nullptr;
+        bool (*integer)(void*, Node::Integer) = nullptr;
+        bool (*floating)(void*, Node::Float) = nullptr;
+        bool (*string)(void*, std::string_view) = nullptr;
+        bool (*startArray)(void*) = nullptr;
+        Target (*element)(void*) = nullptr; // appends an element to the array
+        bool (*startDictionary)(void*) = nullptr;
+        Target (*field)(void*, std::string_view key) = nullptr; // a null target for unknown keys
+        Target (*emplace)(void*) = nullptr; // for optionals, which forward every non-null value
+    };
+
+    template <typename T>
+    struct IsVector : std::false_type { };
+    template <typename T>
+    struct IsVector<std::vector<T>> : std::true_type { };
+
+    template <typename T>
+    struct IsOptional : std::false_type { };
+    template <typename T>
+    struct IsOptional<std::optional<T>> : std::true_type { };
+
+    template <typename T, typename = void>
+    struct HasFields : std::false_type { };
+    template <typename T>
+    struct HasFields<T, std::void_t<decltype(jomlFields(static_cast<const T*>(nullptr)))>>
+        : std::true_type { };
+
+    template <typename T, typename... Members>
+    struct Fields {
+        std::array<std::string_view, sizeof...(Members)> names;
+        std::array<uint64_t, sizeof...(Members)> hashes;
+        std::tuple<Members T::*...> members;
+    };
+
+    template <typename T, typename Member>
+    constexpr std::pair<std::string_view, Member T::*> field(
+        std::string_view name, Member T::*member)
+    {
+        return { name, member };
+    }
+
+    template <typename T, typename... Members>
+    constexpr Fields<T, Members...> makeFields(std::pair<std::string_view, Members T::*>... fields)
+    {
+        return { { fields.first... }, { Key::hash(fields.first)... }, { fields.second... } };
+    }
+
+    template <typename T>
+    constexpr TargetOps makeOps();
+
+    template <typename T>
+    inline constexpr TargetOps targetOps = makeOps<T>();
+
+    template <typename T>
+    Target targetOf(T& object)
+    {
+        return Target { &object, &targetOps<T> };
+    }
+
+    template <typename T, size_t... I>
+    Target fieldTarget(void* object, std::string_view key, std::index_sequence<I...>)
+    {
+        // The hashes of the field names are computed at compile time
+        constexpr auto fields = jomlFields(static_cast<const T*>(nullptr));
+        const auto hash = Key::hash(key);
+        Target target;
+        ((fields.hashes[I] == hash && fields.names[I] == key
+             && (target = targetOf(static_cast<T*>(object)->*std::get<I>(fields.members)), true))
+            || ...);
+        return target;
+    }
+
+    template <typename T>
+    constexpr TargetOps makeOps()
+    {
+        TargetOps ops;
+        if constexpr (std::is_same_v<T, bool>) {
+            ops.boolean = [](void* object, Node::Bool v) {
+                *static_cast<T*>(object) = v;
+                return true;
+            };
+        } else if constexpr (std::is_integral_v<T>) {
+            ops.integer = [](void* object, Node::Integer v) {
+                using Limits = std::numeric_limits<T>;
+                if constexpr (std::is_signed_v<T>) {
+                    if (v < Limits::min() || v > Limits::max()) {
+                        return false;
+                    }
+                } else if (v < 0 || static_cast<uint64_t>(v) > Limits::max()) {
+                    return false;
+                }
+                *static_cast<T*>(object) = static_cast<T>(v);
+                return true;
+            };
+        } else if constexpr (std::is_floating_point_v<T>) {
+            ops.integer = [](void* object, Node::Integer v) {
+                *static_cast<T*>(object) = static_cast<T>(v);
+                return true;
+            };
+            ops.floating = [](void* object, Node::Float v) {
+                *static_cast<T*>(object) = static_cast<T>(v);
+                return true;
+            };
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            ops.string = [](void* object, std::string_view v) {
+                static_cast<T*>(object)->assign(v);
+                return true;
+            };
+        } else if constexpr (IsOptional<T>::value) {
+            ops.null = [](void* object) {
+                static_cast<T*>(object)->reset();
+                return true;
+            };
+            ops.emplace = [](void* object) { return targetOf(static_cast<T*>(object)->emplace()); };
+        } else if constexpr (IsVector<T>::value) {
+            ops.startArray = [](void* object) {
+                static_cast<T*>(object)->clear();
+                return true;
+            };
+            ops.element
+                = [](void* object) { return targetOf(static_cast<T*>(object)->emplace_back()); };
+        } else {
+            static_assert(HasFields<T>::value, "Type can not be parsed into, add JOML_FIELDS");
+            ops.startDictionary = [](void*) { return true; };
+            ops.field = [](void* object, std::string_view key) {
+                constexpr auto numFields = std::tuple_size_v<decltype(
+                    jomlFields(static_cast<const T*>(nullptr)).members)>;
+                return fieldTarget<T>(object, key, std::make_index_sequence<numFields>());
+            };
+        }
+        return ops;
+    }
+
+    std::optional<ParseError> parseInto(std::string_view str, Target root);
+}
+
+// Parses into an existing object, so fields that are missing from the source keep their value
+template <typename T>
+std::optional<ParseError> parseInto(std::string_view str, T& object)
+{
+    static_assert(detail::HasFields<T>::value, "The root has to be a struct with JOML_FIELDS");
+    return detail::parseInto(str, detail::targetOf(object));
+}
+
+template <typename T>
+ParseResult<T> parseInto(std::string_view str)
+{
+    T object {};
+    if (auto err = parseInto(str, object)) {
+        return *err;
+    }
+    return object;
+}
+
 } // namespace joml
+
+// Has to be used in the namespace of the struct, with up to 32 members, e.g.
+// JOML_FIELDS(Config, name, port, limits)
+#define JOML_FIELDS(Type, ...)                                                                     \
+    [[maybe_unused]] constexpr auto jomlFields(const Type*)                                        \
+    {                                                                                              \
+        using JomlFieldsType = Type;                                                               \
+        return joml::detail::makeFields(JOML_FOR_EACH(JOML_FIELD, __VA_ARGS__));                   \
+    }
+#define JOML_FIELD(name) joml::detail::field(#name, &JomlFieldsType::name)
+
+#define JOML_EXPAND(x) x
+#define JOML_FOR_EACH_1(m, x) m(x)
+#define JOML_FOR_EACH_2(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_1(m, __VA_ARGS__))
+#define JOML_FOR_EACH_3(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_2(m, __VA_ARGS__))
+#define JOML_FOR_EACH_4(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_3(m, __VA_ARGS__))
+#define JOML_FOR_EACH_5(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_4(m, __VA_ARGS__))
+#define JOML_FOR_EACH_6(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_5(m, __VA_ARGS__))
+#define JOML_FOR_EACH_7(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_6(m, __VA_ARGS__))
+#define JOML_FOR_EACH_8(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_7(m, __VA_ARGS__))
+#define JOML_FOR_EACH_9(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_8(m, __VA_ARGS__))
+#define JOML_FOR_EACH_10(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_9(m, __VA_ARGS__))
+#define JOML_FOR_EACH_11(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_10(m, __VA_ARGS__))
+#define JOML_FOR_EACH_12(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_11(m, __VA_ARGS__))
+#define JOML_FOR_EACH_13(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_12(m, __VA_ARGS__))
+#define JOML_FOR_EACH_14(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_13(m, __VA_ARGS__))
+#define JOML_FOR_EACH_15(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_14(m, __VA_ARGS__))
+#define JOML_FOR_EACH_16(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_15(m, __VA_ARGS__))
+#define JOML_FOR_EACH_17(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_16(m, __VA_ARGS__))
+#define JOML_FOR_EACH_18(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_17(m, __VA_ARGS__))
+#define JOML_FOR_EACH_19(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_18(m, __VA_ARGS__))
+#define JOML_FOR_EACH_20(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_19(m, __VA_ARGS__))
+#define JOML_FOR_EACH_21(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_20(m, __VA_ARGS__))
+#define JOML_FOR_EACH_22(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_21(m, __VA_ARGS__))
+#define JOML_FOR_EACH_23(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_22(m, __VA_ARGS__))
+#define JOML_FOR_EACH_24(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_23(m, __VA_ARGS__))
+#define JOML_FOR_EACH_25(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_24(m, __VA_ARGS__))
+#define JOML_FOR_EACH_26(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_25(m, __VA_ARGS__))
+#define JOML_FOR_EACH_27(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_26(m, __VA_ARGS__))
+#define JOML_FOR_EACH_28(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_27(m, __VA_ARGS__))
+#define JOML_FOR_EACH_29(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_28(m, __VA_ARGS__))
+#define JOML_FOR_EACH_30(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_29(m, __VA_ARGS__))
+#define JOML_FOR_EACH_31(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_30(m, __VA_ARGS__))
+#define JOML_FOR_EACH_32(m, x, ...) m(x), JOML_EXPAND(JOML_FOR_EACH_31(m, __VA_ARGS__))
+#define JOML_FOR_EACH_N(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+    _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, n, ...) n
+#define JOML_FOR_EACH(m, ...) JOML_EXPAND(JOML_FOR_EACH_N(__VA_ARGS__, JOML_FOR_EACH_32, \
+    JOML_FOR_EACH_31, JOML_FOR_EACH_30, JOML_FOR_EACH_29, JOML_FOR_EACH_28, JOML_FOR_EACH_27, \
+    JOML_FOR_EACH_26, JOML_FOR_EACH_25, JOML_FOR_EACH_24, JOML_FOR_EACH_23, JOML_FOR_EACH_22, \
+    JOML_FOR_EACH_21, JOML_FOR_EACH_20, JOML_FOR_EACH_19, JOML_FOR_EACH_18, JOML_FOR_EACH_17, \
+    JOML_FOR_EACH_16, JOML_FOR_EACH_15, JOML_FOR_EACH_14, JOML_FOR_EACH_13, JOML_FOR_EACH_12, \
+    JOML_FOR_EACH_11, JOML_FOR_EACH_10, JOML_FOR_EACH_9, JOML_FOR_EACH_8, JOML_FOR_EACH_7, \
+    JOML_FOR_EACH_6, JOML_FOR_EACH_5, JOML_FOR_EACH_4, JOML_FOR_EACH_3, JOML_FOR_EACH_2, \
+    JOML_FOR_EACH_1)(m, __VA_ARGS__))
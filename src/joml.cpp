@@ -1,13 +1,43 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <limits>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JOML_HAVE_MMAP
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+// Define JOML_NO_SIMD to only use the scalar code paths
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(JOML_NO_SIMD)
+#include <immintrin.h>
+#define JOML_HAVE_SSE2
+#endif
 
 #include "joml.hpp"
 
-#define JOML_CONTEXT                                                                               \
-    "===========\n" + getContextString(str, getPosition(str, cursor)) + "===========\n"
-#define JOML_DEBUG // std::cout << __FUNCTION__ << '\n' << JOML_CONTEXT << std::endl;
+// Times the rest of the enclosing function in tracing builds
+#ifdef JOML_TRACING
+#define JOML_TRACE const TraceScope traceScope(__func__)
+#else
+#define JOML_TRACE
+#endif
 
 namespace joml {
 namespace utf8 {
@@ -126,6 +156,197 @@ namespace utf8 {
     }
 }
 
+namespace {
+    // Interned keys (see KeyTable) are equal if they are the same characters
+    bool sameKey(const String& a, std::string_view b)
+    {
+        return (a.data() == b.data() && a.size() == b.size()) || a == b;
+    }
+}
+
+const Node* Node::Dictionary::find(std::string_view key) const
+{
+    if (index_) {
+        return find(Key(key));
+    }
+    for (const auto& [k, v] : *this) {
+        if (sameKey(k, key)) {
+            return &v;
+        }
+    }
+    return nullptr;
+}
+
+const Node* Node::Dictionary::find(const Key& key) const
+{
+    if (!index_) {
+        for (const auto& [k, v] : *this) {
+            if (sameKey(k, key.string())) {
+                return &v;
+            }
+        }
+        return nullptr;
+    }
+
+    const auto mask = indexSize_ - 1;
+    const auto hash = static_cast<uint32_t>(key.hash() >> 32);
+    for (auto i = key.hash() & mask; index_[i].entry; i = (i + 1) & mask) {
+        if (index_[i].hash == hash) {
+            const auto& [k, v] = (*this)[index_[i].entry - 1];
+            if (sameKey(k, key.string())) {
+                return &v;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void Node::Dictionary::buildIndex()
+{
+    if (index_ || size() < indexThreshold || size() >= std::numeric_limits<uint32_t>::max()) {
+        return;
+    }
+
+    // Keep the load factor at or below 0.5, so probe sequences stay short
+    indexSize_ = 1;
+    while (indexSize_ < size() * 2) {
+        indexSize_ *= 2;
+    }
+    auto resource = get_allocator().resource();
+    index_ = static_cast<Slot*>(resource->allocate(indexSize_ * sizeof(Slot), alignof(Slot)));
+    std::fill(index_, index_ + indexSize_, Slot { 0, 0 });
+
+    const auto mask = indexSize_ - 1;
+    for (size_t e = 0; e < size(); ++e) {
+        const auto keyHash = Key::hash((*this)[e].first);
+        const auto hash = static_cast<uint32_t>(keyHash >> 32);
+        auto i = keyHash & mask;
+        for (; index_[i].entry; i = (i + 1) & mask) {
+            // Only the first of multiple entries with the same key can be found, like with a scan
+            if (index_[i].hash == hash && (*this)[index_[i].entry - 1].first == (*this)[e].first) {
+                break;
+            }
+        }
+        if (!index_[i].entry) {
+            index_[i] = Slot { static_cast<uint32_t>(e + 1), hash };
+        }
+    }
+}
+
+void Node::Dictionary::dropIndex()
+{
+    if (index_) {
+        get_allocator().resource()->deallocate(index_, indexSize_ * sizeof(Slot), alignof(Slot));
+        index_ = nullptr;
+        indexSize_ = 0;
+    }
+}
+
+bool operator==(const Node& a, const Node& b)
+{
+    std::vector<std::pair<const Node*, const Node*>> stack { { &a, &b } };
+    while (!stack.empty()) {
+        const auto [x, y] = stack.back();
+        stack.pop_back();
+        if (x->tag() != y->tag()) {
+            return false;
+        }
+        if (x->isArray()) {
+            const auto& xs = x->asArray();
+            const auto& ys = y->asArray();
+            if (xs.size() != ys.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < xs.size(); ++i) {
+                stack.emplace_back(&xs[i], &ys[i]);
+            }
+        } else if (x->isDictionary()) {
+            const auto& xd = x->asDictionary();
+            const auto& yd = y->asDictionary();
+            if (xd.size() != yd.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < xd.size(); ++i) {
+                if (xd[i].first != yd[i].first) {
+                    return false;
+                }
+                stack.emplace_back(&xd[i].second, &yd[i].second);
+            }
+        } else if (x->isInteger()) {
+            if (x->asInteger() != y->asInteger()) {
+                return false;
+            }
+        } else if (x->isFloat()) {
+            const auto xf = x->asFloat();
+            const auto yf = y->asFloat();
+            if (xf != yf && !(std::isnan(xf) && std::isnan(yf))) {
+                return false;
+            }
+        } else if (x->isString()) {
+            if (x->asString() != y->asString()) {
+                return false;
+            }
+        } else if (x->isBool()) {
+            if (x->asBool() != y->asBool()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+struct KeyTable::State {
+    // Keys are spread over shards by hash, so threads interning different keys rarely wait for
+    // each other
+    struct Shard {
+        explicit Shard(std::pmr::memory_resource* upstream) : arena(upstream) { }
+
+        std::mutex mutex;
+        std::pmr::monotonic_buffer_resource arena; // of the characters of the keys
+        std::unordered_set<std::string_view> keys;
+    };
+
+    static constexpr size_t numShards = 16;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+};
+
+KeyTable::KeyTable(std::pmr::memory_resource* upstream) : state_(std::make_unique<State>())
+{
+    for (size_t i = 0; i < State::numShards; ++i) {
+        state_->shards.push_back(std::make_unique<State::Shard>(
+            upstream ? upstream : std::pmr::get_default_resource()));
+    }
+}
+
+KeyTable::~KeyTable() = default;
+
+std::string_view KeyTable::intern(std::string_view key)
+{
+    const auto hash = std::hash<std::string_view>()(key);
+    auto& shard = *state_->shards[hash % State::numShards];
+    const std::lock_guard lock(shard.mutex);
+    const auto it = shard.keys.find(key);
+    if (it != shard.keys.end()) {
+        return *it;
+    }
+    const auto data = static_cast<char*>(shard.arena.allocate(std::max<size_t>(key.size(), 1), 1));
+    if (!key.empty()) {
+        std::memcpy(data, key.data(), key.size());
+    }
+    return *shard.keys.emplace(data, key.size()).first;
+}
+
+size_t KeyTable::size() const
+{
+    size_t size = 0;
+    for (const auto& shard : state_->shards) {
+        const std::lock_guard lock(shard->mutex);
+        size += shard->keys.size();
+    }
+    return size;
+}
+
 std::string_view asString(ParseError::Type type)
 {
     switch (type) {
@@ -161,6 +382,18 @@ std::string_view asString(ParseError::Type type)
         return "UnterminatedString";
     case ParseError::Type::InvalidEscape:
         return "InvalidEscape";
+    case ParseError::Type::Aborted:
+        return "Aborted";
+    case ParseError::Type::CouldNotReadFile:
+        return "CouldNotReadFile";
+    case ParseError::Type::InvalidBinary:
+        return "InvalidBinary";
+    case ParseError::Type::OutdatedBinary:
+        return "OutdatedBinary";
+    case ParseError::Type::TypeMismatch:
+        return "TypeMismatch";
+    case ParseError::Type::InvalidPath:
+        return "InvalidPath";
     default:
         return "Unknown";
     }
@@ -172,25 +405,100 @@ std::string ParseError::string() const
         + std::to_string(position.column);
 }
 
+namespace detail {
+    // Follows a parse through the trie of a PathSet, to tell which values are on the way to a
+    // match of one of its paths or below one (see ParseOptions::projection)
+    class Projection {
+    public:
+        explicit Projection(const PathSet& paths);
+
+        // Whether the value of the next entry of the innermost open dictionary or the next element
+        // of the innermost open array is wanted
+        bool selectKey(std::string_view key);
+        bool selectElement();
+
+        // The container is the value that was selected last, or the root
+        void open();
+        void close() { open_.pop_back(); }
+
+    private:
+        struct Frame {
+            size_t begin; // of its trie nodes in active_
+            size_t end;
+            bool whole; // below a match, so everything in it is selected
+            int64_t next; // index of the next element of an array
+        };
+
+        template <typename F>
+        bool select(F matches);
+
+        const PathSet& paths_;
+        std::vector<size_t> active_; // the trie nodes of the open containers and the selected value
+        std::vector<Frame> open_;
+        bool selectedWhole_; // whether the value that was selected last is below a match
+    };
+}
+
 namespace {
+#ifdef JOML_TRACING
+    std::atomic<TraceHook> traceHook { nullptr };
+
+    class TraceScope {
+    public:
+        explicit TraceScope(const char* function)
+            : function_(function)
+            , start_(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~TraceScope()
+        {
+            if (const auto hook = traceHook.load(std::memory_order_relaxed)) {
+                const auto time = std::chrono::steady_clock::now() - start_;
+                hook(function_,
+                    static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(time).count()));
+            }
+        }
+
+    private:
+        const char* function_;
+        std::chrono::steady_clock::time_point start_;
+    };
+#endif
+
+    size_t countCodePoints(std::string_view str)
+    {
+        size_t cursor = 0;
+        size_t count = 0;
+        while (cursor < str.size()) {
+            utf8::readCodePoint(str, cursor);
+            count++;
+        }
+        return count;
+    }
+
+    // For a single lookup, which is not worth building a SourceMap for
     Position getPosition(std::string_view str, size_t cursor)
     {
-        size_t lineStart = 0;
+        cursor = std::min(cursor, str.size());
         size_t line = 1;
-        for (size_t i = 0; i < std::min(cursor, str.size()); ++i) {
-            if (str[i] == '\n') {
-                line++;
-                lineStart = i;
+        size_t lineStart = 0;
+        while (lineStart < cursor) {
+            const auto nl = std::memchr(str.data() + lineStart, '\n', cursor - lineStart);
+            if (!nl) {
+                break;
             }
+            lineStart = static_cast<size_t>(static_cast<const char*>(nl) - str.data()) + 1;
+            line++;
         }
+        return Position { line, 1 + countCodePoints(str.substr(lineStart, cursor - lineStart)) };
+    }
 
-        size_t colCursor = lineStart;
-        size_t column = 1;
-        while (colCursor < std::min(cursor, str.size())) {
-            utf8::readCodePoint(str, colCursor);
-            column++;
-        }
-        return Position { line, column };
+    ParseError resolve(ParseError err, std::string_view str)
+    {
+        err.position = getPosition(str, err.offset);
+        return err;
     }
 
     bool isWhitespace(char ch)
@@ -200,31 +508,222 @@ namespace {
 
     bool skipTo(std::string_view str, size_t& cursor, char to)
     {
-        while (cursor < str.size()) {
-            if (str[cursor] == to) {
-                return true;
-            }
+        if (cursor >= str.size()) {
+            return false;
+        }
+        // memchr is vectorized by every libc that matters
+        const auto found = std::memchr(str.data() + cursor, to, str.size() - cursor);
+        if (!found) {
+            cursor = str.size();
+            return false;
+        }
+        cursor = static_cast<size_t>(static_cast<const char*>(found) - str.data());
+        return true;
+    }
+
+    // Returns the end of the run of whitespace at cursor and sets newline if the run contains one
+    size_t skipWhitespaceScalar(std::string_view str, size_t cursor, bool& newline)
+    {
+        while (cursor < str.size() && isWhitespace(str[cursor])) {
+            newline = newline || str[cursor] == '\n';
             cursor++;
         }
-        return false;
+        return cursor;
+    }
+
+#ifdef JOML_HAVE_SSE2
+    size_t skipWhitespaceSse2(std::string_view str, size_t cursor, bool& newline)
+    {
+        while (cursor + 16 <= str.size()) {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + cursor));
+            const auto nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+            const auto ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), nl),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+            const auto wsMask = static_cast<uint32_t>(_mm_movemask_epi8(ws));
+            const auto nlMask = static_cast<uint32_t>(_mm_movemask_epi8(nl));
+            if (wsMask != 0xffff) {
+                const auto n = static_cast<size_t>(__builtin_ctz(~wsMask));
+                newline = newline || (nlMask & ((1u << n) - 1)) != 0;
+                return cursor + n;
+            }
+            newline = newline || nlMask != 0;
+            cursor += 16;
+        }
+        return skipWhitespaceScalar(str, cursor, newline);
+    }
+
+    __attribute__((target("avx2"))) size_t skipWhitespaceAvx2(
+        std::string_view str, size_t cursor, bool& newline)
+    {
+        while (cursor + 32 <= str.size()) {
+            const auto v
+                = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str.data() + cursor));
+            const auto nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+            const auto ws
+                = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), nl),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+            const auto wsMask = static_cast<uint32_t>(_mm256_movemask_epi8(ws));
+            const auto nlMask = static_cast<uint32_t>(_mm256_movemask_epi8(nl));
+            if (wsMask != 0xffffffff) {
+                const auto n = static_cast<size_t>(__builtin_ctz(~wsMask));
+                newline = newline || (nlMask & ((1u << n) - 1)) != 0;
+                return cursor + n;
+            }
+            newline = newline || nlMask != 0;
+            cursor += 32;
+        }
+        return skipWhitespaceSse2(str, cursor, newline);
+    }
+#endif
+
+    // Returns the offset of the first '"' or '\\' at or after cursor or npos if there is none
+    size_t findQuoteOrBackslashScalar(std::string_view str, size_t cursor)
+    {
+        for (; cursor < str.size(); ++cursor) {
+            if (str[cursor] == '"' || str[cursor] == '\\') {
+                return cursor;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+#ifdef JOML_HAVE_SSE2
+    size_t findQuoteOrBackslashSse2(std::string_view str, size_t cursor)
+    {
+        while (cursor + 16 <= str.size()) {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + cursor));
+            const auto m = _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+            const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(m));
+            if (mask) {
+                return cursor + static_cast<size_t>(__builtin_ctz(mask));
+            }
+            cursor += 16;
+        }
+        return findQuoteOrBackslashScalar(str, cursor);
+    }
+
+    __attribute__((target("avx2"))) size_t findQuoteOrBackslashAvx2(
+        std::string_view str, size_t cursor)
+    {
+        while (cursor + 32 <= str.size()) {
+            const auto v
+                = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str.data() + cursor));
+            const auto m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+            const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(m));
+            if (mask) {
+                return cursor + static_cast<size_t>(__builtin_ctz(mask));
+            }
+            cursor += 32;
+        }
+        return findQuoteOrBackslashSse2(str, cursor);
+    }
+#endif
+
+    bool needsJsonEscape(char ch)
+    {
+        return ch == '"' || ch == '\\' || static_cast<uint8_t>(ch) < 0x20 || ch == 0x7f;
+    }
+
+    // Returns the offset of the first character at or after cursor that has to be escaped in JSON
+    // or npos if there is none
+    size_t findJsonEscapeScalar(std::string_view str, size_t cursor)
+    {
+        for (; cursor < str.size(); ++cursor) {
+            if (needsJsonEscape(str[cursor])) {
+                return cursor;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+#ifdef JOML_HAVE_SSE2
+    size_t findJsonEscapeSse2(std::string_view str, size_t cursor)
+    {
+        while (cursor + 16 <= str.size()) {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + cursor));
+            // v <= 0x1f as unsigned bytes
+            const auto control = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v);
+            const auto m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                _mm_or_si128(control, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f))));
+            const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(m));
+            if (mask) {
+                return cursor + static_cast<size_t>(__builtin_ctz(mask));
+            }
+            cursor += 16;
+        }
+        return findJsonEscapeScalar(str, cursor);
+    }
+
+    __attribute__((target("avx2"))) size_t findJsonEscapeAvx2(std::string_view str, size_t cursor)
+    {
+        while (cursor + 32 <= str.size()) {
+            const auto v
+                = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str.data() + cursor));
+            const auto control
+                = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v);
+            const auto m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+                _mm256_or_si256(control, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f))));
+            const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(m));
+            if (mask) {
+                return cursor + static_cast<size_t>(__builtin_ctz(mask));
+            }
+            cursor += 32;
+        }
+        return findJsonEscapeSse2(str, cursor);
+    }
+#endif
+
+    // The widest implementation the CPU supports, picked once at startup
+    struct Kernels {
+        size_t (*skipWhitespace)(std::string_view str, size_t cursor, bool& newline);
+        size_t (*findQuoteOrBackslash)(std::string_view str, size_t cursor);
+        size_t (*findJsonEscape)(std::string_view str, size_t cursor);
+    };
+
+    Kernels selectKernels()
+    {
+#ifdef JOML_HAVE_SSE2
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernels { skipWhitespaceAvx2, findQuoteOrBackslashAvx2, findJsonEscapeAvx2 };
+        }
+        return Kernels { skipWhitespaceSse2, findQuoteOrBackslashSse2, findJsonEscapeSse2 };
+#else
+        return Kernels { skipWhitespaceScalar, findQuoteOrBackslashScalar, findJsonEscapeScalar };
+#endif
     }
 
+    const Kernels kernels = selectKernels();
+
     // returns whether a newline was skipped
     bool skip(std::string_view str, size_t& cursor)
     {
-        JOML_DEBUG;
+        JOML_TRACE;
         bool skippedNewline = false;
         while (cursor < str.size()) {
             if (str[cursor] == '#') {
                 if (!skipTo(str, cursor, '\n'))
                     break;
                 skippedNewline = true;
-            } else if (!isWhitespace(str[cursor])) {
+                cursor++;
+            } else if (isWhitespace(str[cursor])) {
+                // runs of a single character (like a space after a colon) are not worth the call
+                if (cursor + 1 < str.size() && !isWhitespace(str[cursor + 1])) {
+                    skippedNewline = skippedNewline || str[cursor] == '\n';
+                    cursor++;
+                } else {
+                    cursor = kernels.skipWhitespace(str, cursor, skippedNewline);
+                }
+            } else {
                 break;
-            } else if (str[cursor] == '\n') {
-                skippedNewline = true;
             }
-            cursor++;
         }
         return skippedNewline;
     }
@@ -243,26 +742,19 @@ namespace {
         }
     }
 
-    ParseError makeError(ParseError::Type type, std::string_view str, size_t cursor)
+    // The position is resolved by the public entry points, which know the whole source
+    ParseError makeError(ParseError::Type type, size_t cursor)
     {
-        return ParseError { type, getPosition(str, cursor) };
+        return ParseError { type, Position {}, cursor };
     }
 
-    std::optional<uint32_t> parseHexEscape(std::string_view str)
+    // Returns a value > 15 if ch is not a hex digit
+    uint32_t hexDigitValue(char ch)
     {
-        if (str.find_first_not_of("0123456789abcdefABCDEF") != std::string_view::npos) {
-            return std::nullopt;
-        }
-        try {
-            size_t pos = 0;
-            const auto num = std::stoul(std::string(str), &pos, 16);
-            if (pos != str.size()) {
-                return std::nullopt;
-            }
-            return num;
-        } catch (const std::exception&) {
-            return std::nullopt;
-        }
+        const auto c = static_cast<uint32_t>(static_cast<uint8_t>(ch));
+        const auto digit = c - '0';
+        const auto letter = (c | 0x20) - 'a'; // lowercase
+        return digit < 10 ? digit : (letter < 6 ? letter + 10 : 16);
     }
 
     std::optional<uint32_t> parseHexEscape(std::string_view str, size_t& cursor, size_t num)
@@ -270,12 +762,18 @@ namespace {
         if (cursor + num >= str.size()) {
             return std::nullopt;
         }
-        const auto n = parseHexEscape(str.substr(cursor, num));
-        if (!n) {
+        uint32_t value = 0;
+        uint32_t invalid = 0;
+        for (size_t i = 0; i < num; ++i) {
+            const auto digit = hexDigitValue(str[cursor + i]);
+            invalid |= digit;
+            value = (value << 4) | (digit & 0xf);
+        }
+        if (invalid > 15) {
             return std::nullopt;
         }
         cursor += num;
-        return *n;
+        return value;
     }
 
     std::optional<std::string> parseUnicodeHexEscape(
@@ -292,19 +790,39 @@ namespace {
         return *s;
     }
 
-    ParseResult<std::string> parseString(std::string_view str, size_t& cursor)
+    std::optional<ParseError> checkHandler(bool proceed, size_t cursor)
+    {
+        if (!proceed) {
+            return makeError(ParseError::Type::Aborted, cursor);
+        }
+        return std::nullopt;
+    }
+
+    // Returns a view into str if the string does not contain escapes and into scratch otherwise.
+    // The number of escapes is added to escapes.
+    ParseResult<std::string_view> parseString(
+        std::string_view str, size_t& cursor, std::string& scratch, size_t& escapes)
     {
-        JOML_DEBUG;
+        JOML_TRACE;
         assert(cursor < str.size());
         assert(str[cursor] == '"');
         cursor++;
-        std::string ret;
-        ret.reserve(32);
-        while (cursor < str.size()) {
+        auto end = kernels.findQuoteOrBackslash(str, cursor);
+        if (end != std::string_view::npos && str[end] == '"') {
+            const auto view = str.substr(cursor, end - cursor);
+            cursor = end + 1;
+            return view;
+        }
+        auto& ret = scratch;
+        ret.clear();
+        while (end != std::string_view::npos) {
+            ret.append(str.data() + cursor, end - cursor);
+            cursor = end;
             if (str[cursor] == '\\') {
+                escapes++;
                 cursor++;
                 if (cursor >= str.size()) {
-                    return makeError(ParseError::Type::InvalidEscape, str, cursor);
+                    return makeError(ParseError::Type::InvalidEscape, cursor);
                 }
                 const auto c = str[cursor];
                 switch (c) {
@@ -320,7 +838,7 @@ namespace {
                     // I think this is the only spot, where I have to handle Windows newlines
                     // explicitly and the code doesn't "just work" for CRLF.
                     if (cursor + 1 >= str.size() || str[cursor + 1] != '\n') {
-                        return makeError(ParseError::Type::InvalidEscape, str, cursor);
+                        return makeError(ParseError::Type::InvalidEscape, cursor);
                     }
                     [[fallthrough]];
                 case '\n':
@@ -353,7 +871,7 @@ namespace {
                     cursor++;
                     const auto x = parseHexEscape(str, cursor, 2);
                     if (!x) {
-                        return makeError(ParseError::Type::InvalidEscape, str, cursor);
+                        return makeError(ParseError::Type::InvalidEscape, cursor);
                     }
                     ret.append(1, static_cast<char>(*x));
                     break;
@@ -362,7 +880,7 @@ namespace {
                     cursor++;
                     const auto s = parseUnicodeHexEscape(str, cursor, 4);
                     if (!s) {
-                        return makeError(ParseError::Type::InvalidEscape, str, cursor);
+                        return makeError(ParseError::Type::InvalidEscape, cursor);
                     }
                     ret.append(*s);
                     break;
@@ -371,207 +889,221 @@ namespace {
                     cursor++;
                     const auto s = parseUnicodeHexEscape(str, cursor, 8);
                     if (!s) {
-                        return makeError(ParseError::Type::InvalidEscape, str, cursor);
+                        return makeError(ParseError::Type::InvalidEscape, cursor);
                     }
                     ret.append(*s);
                     break;
                 }
                 default:
-                    return makeError(ParseError::Type::InvalidEscape, str, cursor);
+                    return makeError(ParseError::Type::InvalidEscape, cursor);
                 }
-            } else if (str[cursor] == '"') {
-                cursor++; // Advance past closing quote
-                return ret;
             } else {
-                ret.append(1, str[cursor]);
-                cursor++;
+                cursor++; // Advance past closing quote
+                return std::string_view(ret);
             }
+            end = kernels.findQuoteOrBackslash(str, cursor);
         }
-        return makeError(ParseError::Type::UnterminatedString, str, cursor);
+        cursor = str.size();
+        return makeError(ParseError::Type::UnterminatedString, cursor);
     }
 
-    ParseResult<std::string> parseKey(std::string_view str, size_t& cursor)
+    ParseResult<std::string_view> parseKey(
+        std::string_view str, size_t& cursor, std::string& scratch, size_t& escapes)
     {
-        JOML_DEBUG;
+        JOML_TRACE;
         if (cursor >= str.size()) {
-            return makeError(ParseError::Type::ExpectedKey, str, cursor);
+            return makeError(ParseError::Type::ExpectedKey, cursor);
         }
         if (str[cursor] == '"') {
-            const auto s = parseString(str, cursor);
+            const auto s = parseString(str, cursor, scratch, escapes);
             if (!s) {
                 return s.error();
             }
             skip(str, cursor);
             if (cursor >= str.size() || str[cursor] != ':') {
-                return makeError(ParseError::Type::ExpectedColon, str, cursor);
+                return makeError(ParseError::Type::ExpectedColon, cursor);
             }
             cursor++;
             return *s;
         } else {
             const auto start = cursor;
             if (!skipTo(str, cursor, ':')) {
-                return makeError(ParseError::Type::ExpectedColon, str, cursor);
+                return makeError(ParseError::Type::ExpectedColon, cursor);
             }
             const auto key = str.substr(start, cursor - start);
             if (key.empty()) {
-                return makeError(ParseError::Type::InvalidKey, str, cursor);
+                return makeError(ParseError::Type::InvalidKey, cursor);
             }
             cursor++; // skip ':'
-            return std::string(key);
+            return key;
         }
     }
 
-    std::optional<Node::Integer> parseInteger(std::string_view str, int base)
+    // The sign has already been consumed by parseNumber, so str must not have another one
+    std::optional<Node::Integer> parseInteger(std::string_view str, int base, bool negative)
     {
-        try {
-            size_t pos = 0;
-            const auto num = std::stoll(std::string(str), &pos, base);
-            if (pos != str.size()) {
-                return std::nullopt;
-            }
-            return num;
-        } catch (const std::exception&) {
+        uint64_t magnitude = 0;
+        const auto end = str.data() + str.size();
+        const auto [ptr, ec] = std::from_chars(str.data(), end, magnitude, base);
+        if (ec != std::errc() || ptr != end) {
+            return std::nullopt;
+        }
+        constexpr auto max = static_cast<uint64_t>(std::numeric_limits<Node::Integer>::max());
+        if (magnitude > max + (negative ? 1 : 0)) {
             return std::nullopt;
         }
+        if (negative) {
+            // -magnitude would overflow for the minimum
+            return magnitude ? -static_cast<Node::Integer>(magnitude - 1) - 1 : 0;
+        }
+        return static_cast<Node::Integer>(magnitude);
     }
 
-    std::optional<Node::Float> parseFloat(std::string_view str)
+    std::optional<Node::Float> parseFloat(std::string_view str, bool negative)
     {
-        try {
-            size_t pos = 0;
-            const auto num = std::stof(std::string(str), &pos);
-            if (pos != str.size()) {
-                return std::nullopt;
-            }
-            return num;
-        } catch (const std::exception&) {
+        if (str.empty() || str[0] == '-') {
+            return std::nullopt;
+        }
+        Node::Float num = 0.0;
+        const auto end = str.data() + str.size();
+        const auto [ptr, ec] = std::from_chars(str.data(), end, num);
+        if (ec != std::errc() || ptr != end) {
             return std::nullopt;
         }
+        return negative ? -num : num;
     }
 
     ParseResult<Node> parseNumber(std::string_view str, size_t cursor, size_t cursorEnd)
     {
-        JOML_DEBUG;
+        JOML_TRACE;
         assert(cursor < str.size());
         // must be a number of some kind
-        const int sign = str[cursor] == '-' ? -1 : 1;
+        const auto negative = str[cursor] == '-';
         if (str[cursor] == '+' || str[cursor] == '-') {
             cursor++;
         }
         const auto value = str.substr(cursor, cursorEnd - cursor);
 
         if (value == "inf") {
-            return Node(sign * std::numeric_limits<Node::Float>::infinity());
+            const auto inf = std::numeric_limits<Node::Float>::infinity();
+            return Node(negative ? -inf : inf);
         } else if (value == "nan") {
             return Node { nan<Node::Float>() };
         }
 
         const auto prefix = value.substr(0, 2);
         if (prefix == "0x") {
-            const auto n = parseInteger(value.substr(2), 16);
+            const auto n = parseInteger(value.substr(2), 16, negative);
             if (!n) {
-                return makeError(ParseError::Type::CouldNotParseHexNumber, str, cursor);
+                return makeError(ParseError::Type::CouldNotParseHexNumber, cursor);
             }
-            return Node(sign * *n);
+            return Node(*n);
         } else if (prefix == "0o") {
-            const auto n = parseInteger(value.substr(2), 8);
+            const auto n = parseInteger(value.substr(2), 8, negative);
             if (!n) {
-                return makeError(ParseError::Type::CouldNotParseOctalNumber, str, cursor);
+                return makeError(ParseError::Type::CouldNotParseOctalNumber, cursor);
             }
-            return Node(sign * *n);
+            return Node(*n);
         } else if (prefix == "0b") {
-            const auto n = parseInteger(value.substr(2), 2);
+            const auto n = parseInteger(value.substr(2), 2, negative);
             if (!n) {
-                return makeError(ParseError::Type::CouldNotParseBinaryNumber, str, cursor);
+                return makeError(ParseError::Type::CouldNotParseBinaryNumber, cursor);
             }
-            return Node(sign * *n);
+            return Node(*n);
         }
 
         // all digits
-        if (value.find_first_not_of("0123456789") == std::string::npos) {
-            const auto n = parseInteger(value, 10);
+        const auto isDigit = [](char ch) { return ch >= '0' && ch <= '9'; };
+        if (std::all_of(value.begin(), value.end(), isDigit)) {
+            const auto n = parseInteger(value, 10, negative);
             if (!n) {
-                return makeError(ParseError::Type::CouldNotParseDecimalIntegerNumber, str, cursor);
+                return makeError(ParseError::Type::CouldNotParseDecimalIntegerNumber, cursor);
             }
-            return Node(sign * *n);
+            return Node(*n);
         }
 
-        if (value.find_first_not_of("0123456789.eE+-") == std::string::npos) {
-            const auto n = parseFloat(value);
+        const auto isFloatChar = [&](char ch) {
+            return isDigit(ch) || ch == '.' || ch == 'e' || ch == 'E' || ch == '+' || ch == '-';
+        };
+        if (std::all_of(value.begin(), value.end(), isFloatChar)) {
+            const auto n = parseFloat(value, negative);
             if (!n) {
-                return makeError(ParseError::Type::CouldNotParseFloatNumber, str, cursor);
+                return makeError(ParseError::Type::CouldNotParseFloatNumber, cursor);
             }
-            return Node(sign * *n);
+            return Node(*n);
         }
 
-        return makeError(ParseError::Type::InvalidValue, str, cursor);
+        return makeError(ParseError::Type::InvalidValue, cursor);
     }
 
-    ParseResult<Node::Array> parseArray(std::string_view str, size_t& cursor);
-    ParseResult<Node::Dictionary> parseDictionary(
-        std::string_view str, size_t& cursor, bool isRoot = false);
+    // The characters of numbers, null, true, false, inf and nan
+    constexpr std::string_view valueChars
+        = "0123456789abcdefghijlmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.+-";
+
+    bool isValueChar(char ch)
+    {
+        static constexpr auto table = [] {
+            std::array<bool, 256> table {};
+            for (const auto c : valueChars) {
+                table[static_cast<uint8_t>(c)] = true;
+            }
+            return table;
+        }();
+        return table[static_cast<uint8_t>(ch)];
+    }
 
-    ParseResult<Node> parseNode(std::string_view str, size_t& cursor)
+    // Parses anything but containers
+    template <typename H>
+    std::optional<ParseError> parseValue(
+        std::string_view str, size_t& cursor, H& handler, std::string& scratch, size_t& escapes)
     {
-        JOML_DEBUG;
+        JOML_TRACE;
         if (cursor >= str.size())
-            return makeError(ParseError::Type::NoValue, str, cursor);
+            return makeError(ParseError::Type::NoValue, cursor);
 
-        if (str[cursor] == '{') {
-            cursor++;
-            auto res = parseDictionary(str, cursor);
-            if (!res) {
-                return res.error();
-            }
-            return Node(std::move(*res));
-        } else if (str[cursor] == '[') {
-            cursor++;
-            auto res = parseArray(str, cursor);
-            if (!res) {
-                return res.error();
-            }
-            return Node(std::move(*res));
-        } else if (str[cursor] == '"') {
-            const auto s = parseString(str, cursor);
+        const auto start = cursor;
+        if (str[cursor] == '"') {
+            const auto s = parseString(str, cursor, scratch, escapes);
             if (!s) {
                 return s.error();
             }
-            return Node(*s);
-        } else {
-            const auto valueChars
-                = "0123456789abcdefghijlmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.+-";
-            auto valueEnd = str.find_first_not_of(valueChars, cursor);
-            if (valueEnd == std::string_view::npos) {
-                valueEnd = str.size();
-            }
-            const auto value = str.substr(cursor, valueEnd - cursor);
-            if (value.empty()) {
-                return makeError(ParseError::Type::NoValue, str, cursor);
-            }
+            return checkHandler(handler.string(*s), start);
+        }
 
-            if (value == "null") {
-                cursor += value.size();
-                return Node(Node::Null {});
-            } else if (value == "true") {
-                cursor += value.size();
-                return Node(true);
-            } else if (value == "false") {
-                cursor += value.size();
-                return Node(false);
-            }
+        auto valueEnd = cursor;
+        while (valueEnd < str.size() && isValueChar(str[valueEnd])) {
+            valueEnd++;
+        }
+        const auto value = str.substr(cursor, valueEnd - cursor);
+        if (value.empty()) {
+            return makeError(ParseError::Type::NoValue, cursor);
+        }
 
-            auto node = parseNumber(str, cursor, valueEnd);
-            if (!node) {
-                return node;
-            }
+        if (value == "null") {
+            cursor += value.size();
+            return checkHandler(handler.null(), start);
+        } else if (value == "true") {
+            cursor += value.size();
+            return checkHandler(handler.boolean(true), start);
+        } else if (value == "false") {
             cursor += value.size();
-            return node;
+            return checkHandler(handler.boolean(false), start);
         }
+
+        const auto node = parseNumber(str, cursor, valueEnd);
+        if (!node) {
+            return node.error();
+        }
+        cursor += value.size();
+        if ((*node).isInteger()) {
+            return checkHandler(handler.integer((*node).asInteger()), start);
+        }
+        return checkHandler(handler.floating((*node).asFloat()), start);
     }
 
     bool skipSeparator(std::string_view str, size_t& cursor)
     {
-        JOML_DEBUG;
+        JOML_TRACE;
         bool separatorFound = skip(str, cursor);
         if (cursor < str.size() && str[cursor] == ',') {
             separatorFound = true;
@@ -581,108 +1113,3357 @@ namespace {
         return separatorFound;
     }
 
-    ParseResult<Node::Array> parseArray(std::string_view str, size_t& cursor)
+    // Skips the value at cursor by only matching brackets and quotes, like the Scanner. Nothing
+    // else is checked, so this is only for trusted input. open is scratch space for the nesting.
+    std::optional<ParseError> skipValueTrusted(
+        std::string_view str, size_t& cursor, std::vector<bool>& open)
     {
-        JOML_DEBUG;
-        Node::Array arr;
-        while (cursor < str.size()) {
-            skip(str, cursor);
-            auto value = parseNode(str, cursor);
-            if (!value) {
-                return value.error();
+        JOML_TRACE;
+        const auto skipString = [&]() {
+            cursor++;
+            while (true) {
+                const auto end = kernels.findQuoteOrBackslash(str, cursor);
+                if (end == std::string_view::npos) {
+                    cursor = str.size();
+                    return false;
+                }
+                cursor = end + (str[end] == '\\' ? 2 : 1);
+                if (str[end] == '"') {
+                    return true;
+                }
             }
-            arr.emplace_back(Node(std::move(*value)));
+        };
 
-            const auto separatorFound = skipSeparator(str, cursor);
-
-            if (cursor < str.size() && str[cursor] == ']') {
-                cursor++;
-                break;
+        open.clear();
+        bool atKey = false; // at the key of the next entry of a dictionary (or its '}')
+        do {
+            skip(str, cursor);
+            if (cursor >= str.size()) {
+                return makeError(ParseError::Type::ExpectedDictClose, cursor);
             }
-
-            if (!separatorFound) {
-                return makeError(ParseError::Type::NoSeparator, str, cursor);
+            const auto ch = str[cursor];
+            if (open.empty() && (ch == ',' || ch == '}' || ch == ']')) {
+                return makeError(ParseError::Type::NoValue, cursor);
+            } else if (ch == ',') {
+                cursor++;
+            } else if (ch == '}' || ch == ']') {
+                cursor++;
+                open.pop_back();
+                atKey = !open.empty() && open.back();
+            } else if (atKey) {
+                // A raw key is everything up to the ':'
+                if (ch == '"' && !skipString()) {
+                    return makeError(ParseError::Type::UnterminatedString, cursor);
+                }
+                if (!skipTo(str, cursor, ':')) {
+                    return makeError(ParseError::Type::ExpectedColon, cursor);
+                }
+                cursor++;
+                atKey = false;
+            } else if (ch == '{' || ch == '[') {
+                cursor++;
+                open.push_back(ch == '{');
+                atKey = ch == '{';
+            } else {
+                if (ch == '"') {
+                    if (!skipString()) {
+                        return makeError(ParseError::Type::UnterminatedString, cursor);
+                    }
+                } else {
+                    const auto start = cursor;
+                    while (cursor < str.size() && isValueChar(str[cursor])) {
+                        cursor++;
+                    }
+                    if (cursor == start) {
+                        return makeError(ParseError::Type::NoValue, cursor);
+                    }
+                }
+                atKey = !open.empty() && open.back();
             }
-        }
-        return arr;
+        } while (!open.empty());
+        return std::nullopt;
     }
 
-    ParseResult<Node::Dictionary> parseDictionary(std::string_view str, size_t& cursor, bool isRoot)
-    {
-        JOML_DEBUG;
-        Node::Dictionary dict;
-        while (cursor < str.size()) {
-            skip(str, cursor);
+    // Takes the events of values that are parsed only to check them
+    struct DiscardingHandler {
+        bool null() { return true; }
+        bool boolean(Node::Bool) { return true; }
+        bool integer(Node::Integer) { return true; }
+        bool floating(Node::Float) { return true; }
+        bool string(std::string_view) { return true; }
+    };
 
-            if (str[cursor] == '}') {
-                cursor++;
-                break;
-            }
+    // Handlers with an element(size_t offset) method are told where each key-value pair of a
+    // dictionary and each value of an array starts.
+    template <typename H, typename = void>
+    struct WantsElements : std::false_type { };
 
-            const auto key = parseKey(str, cursor);
-            if (!key) {
-                return key.error();
-            }
+    template <typename H>
+    struct WantsElements<H, std::void_t<decltype(std::declval<H&>().element(size_t()))>>
+        : std::true_type { };
 
-            skip(str, cursor);
-            auto value = parseNode(str, cursor);
-            if (!value) {
-                return value.error();
-            }
-            dict.emplace_back(std::move(*key), Node(std::move(*value)));
+    // Handlers with selectKey(std::string_view key), selectElement(), skipped() and trusted()
+    // methods choose the values they get. The entries of dictionaries that they don't select are
+    // left out without any events and the elements of arrays are replaced by a skipped() event.
+    // The values are only matched up by brackets and quotes if the handler trusts the input, and
+    // parsed without events otherwise, so they fail the parse exactly like they would without it.
+    template <typename H, typename = void>
+    struct Projects : std::false_type { };
 
-            const auto separatorFound = skipSeparator(str, cursor);
+    template <typename H>
+    struct Projects<H, std::void_t<decltype(std::declval<H&>().selectKey(std::string_view()))>>
+        : std::true_type { };
 
-            if (cursor >= str.size()) {
-                if (isRoot) {
-                    // we don't need a separator or a '}' for the root dict
-                    break;
-                } else {
-                    return makeError(ParseError::Type::ExpectedDictClose, str, cursor);
-                }
-            }
+    // Keeps the open containers on a stack instead of recursing, so deep nesting can not overflow
+    // the call stack and a parse can be suspended at the start of an element (see PushParser).
+    template <typename H>
+    class Parser {
+    public:
+        explicit Parser(H& handler) : handler_(handler) { }
 
-            if (!separatorFound) {
-                return makeError(ParseError::Type::NoSeparator, str, cursor);
-            }
+        // Continues a parse that somebody else started and suspended between two elements of a
+        // container, without another start event for it.
+        void resume(bool isDictionary)
+        {
+            started_ = true;
+            open_.push_back(isDictionary);
         }
-        return dict;
-    }
-}
 
-// inefficient
-std::string getContextString(std::string_view str, const Position& position)
-{
-    std::vector<size_t> lineStarts { 0 };
-    for (size_t i = 0; i < str.size(); ++i) {
-        if (str[i] == '\n') {
-            lineStarts.push_back(i + 1);
+        bool done() const { return started_ && open_.empty(); }
+        bool atRoot() const { return open_.size() == 1; }
+        size_t escapes() const { return escapes_; }
+
+        // Parses from cursor until the root dictionary is closed. If !atEnd, the document continues
+        // after str and the parse is suspended once it reaches the end of str between two elements.
+        std::optional<ParseError> parse(std::string_view str, size_t& cursor, bool atEnd)
+        {
+            JOML_TRACE;
+            if (!started_) {
+                started_ = true;
+                open_.push_back(true);
+                if (auto err = checkHandler(handler_.startDictionary(), cursor)) {
+                    return err;
+                }
+            }
+
+            bool afterValue = false;
+            bool afterOpen = false;
+            while (!open_.empty()) {
+                const auto opened = std::exchange(afterOpen, false);
+                if (afterValue) {
+                    afterValue = false;
+                    const auto separatorFound = skipSeparator(str, cursor);
+                    if (cursor >= str.size() && !atEnd) {
+                        return std::nullopt;
+                    }
+
+                    if (open_.back()) {
+                        if (cursor >= str.size()) {
+                            if (open_.size() > 1) {
+                                return makeError(ParseError::Type::ExpectedDictClose, cursor);
+                            }
+                            // we don't need a separator or a '}' for the root dict
+                            if (auto err = close(cursor, afterValue)) {
+                                return err;
+                            }
+                            continue;
+                        }
+                    } else if (cursor < str.size() && str[cursor] == ']') {
+                        cursor++;
+                        if (auto err = close(cursor, afterValue)) {
+                            return err;
+                        }
+                        continue;
+                    }
+
+                    if (!separatorFound) {
+                        return makeError(ParseError::Type::NoSeparator, cursor);
+                    }
+                }
+
+                if (cursor >= str.size()) {
+                    if (!atEnd) {
+                        return std::nullopt;
+                    }
+                    if (auto err = close(cursor, afterValue)) {
+                        return err;
+                    }
+                    continue;
+                }
+
+                skip(str, cursor);
+                auto selected = !muted();
+                if (open_.back()) {
+                    if (cursor < str.size() && str[cursor] == '}') {
+                        cursor++;
+                        if (auto err = close(cursor, afterValue)) {
+                            return err;
+                        }
+                        continue;
+                    }
+
+                    const auto keyStart = cursor;
+                    elementStart(keyStart);
+                    const auto key = parseKey(str, cursor, scratch_, escapes_);
+                    if (!key) {
+                        return key.error();
+                    }
+                    if constexpr (Projects<H>::value) {
+                        selected = selected && handler_.selectKey(*key);
+                    }
+                    if (selected) {
+                        if (auto err = checkHandler(handler_.key(*key), keyStart)) {
+                            return err;
+                        }
+                    }
+                    skip(str, cursor);
+                } else if (opened && cursor < str.size() && str[cursor] == ']') {
+                    // an empty array, a ']' anywhere else has to follow a value
+                    cursor++;
+                    if (auto err = close(cursor, afterValue)) {
+                        return err;
+                    }
+                    continue;
+                } else {
+                    elementStart(cursor);
+                    if constexpr (Projects<H>::value) {
+                        if (selected && !handler_.selectElement()) {
+                            selected = false;
+                            if (auto err = checkHandler(handler_.skipped(), cursor)) {
+                                return err;
+                            }
+                        }
+                    }
+                }
+
+                if constexpr (Projects<H>::value) {
+                    if (!selected && !muted() && handler_.trusted()) {
+                        if (auto err = skipValueTrusted(str, cursor, skipped_)) {
+                            return err;
+                        }
+                        afterValue = true;
+                        continue;
+                    }
+                }
+
+                if (cursor < str.size() && (str[cursor] == '{' || str[cursor] == '[')) {
+                    const auto isDictionary = str[cursor] == '{';
+                    if (selected) {
+                        const auto proceed
+                            = isDictionary ? handler_.startDictionary() : handler_.startArray();
+                        if (auto err = checkHandler(proceed, cursor)) {
+                            return err;
+                        }
+                    }
+                    cursor++;
+                    open_.push_back(isDictionary);
+                    if (!selected && !muted()) {
+                        mutedAt_ = open_.size();
+                    }
+                    afterOpen = true;
+                    continue;
+                }
+
+                if (selected) {
+                    if (auto err = parseValue(str, cursor, handler_, scratch_, escapes_)) {
+                        return err;
+                    }
+                } else {
+                    DiscardingHandler discard;
+                    if (auto err = parseValue(str, cursor, discard, scratch_, escapes_)) {
+                        return err;
+                    }
+                }
+                afterValue = true;
+            }
+            return std::nullopt;
+        }
+
+    private:
+        void elementStart(size_t cursor)
+        {
+            if constexpr (WantsElements<H>::value) {
+                handler_.element(cursor);
+            }
+        }
+
+        // Whether the events of the current values are left out, because a container that is not
+        // selected is open (see Projects)
+        bool muted() const
+        {
+            if constexpr (Projects<H>::value) {
+                return mutedAt_ != 0;
+            }
+            return false;
+        }
+
+        std::optional<ParseError> close(size_t cursor, bool& afterValue)
+        {
+            const auto isDictionary = open_.back();
+            const auto selected = !muted();
+            if (open_.size() == mutedAt_) {
+                mutedAt_ = 0;
+            }
+            open_.pop_back();
+            afterValue = !open_.empty();
+            if (!selected) {
+                return std::nullopt;
+            }
+            const auto proceed = isDictionary ? handler_.endDictionary() : handler_.endArray();
+            return checkHandler(proceed, cursor);
+        }
+
+        H& handler_;
+        std::string scratch_; // strings with escapes are decoded in here
+        size_t escapes_ = 0; // decoded so far
+        std::vector<bool> open_; // whether each open container is a dictionary
+        size_t mutedAt_ = 0; // size of open_ once the outermost muted container was opened
+        std::vector<bool> skipped_; // scratch space for skipValueTrusted
+        bool started_ = false;
+    };
+
+    template <typename H>
+    std::optional<ParseError> parseRoot(std::string_view str, H& handler)
+    {
+        Parser<H> parser(handler);
+        size_t cursor = 0;
+        if (auto err = parser.parse(str, cursor, true)) {
+            return resolve(*err, str);
+        }
+        return std::nullopt;
+    }
+
+    // Passes the events on to another handler and counts them. Strings are copied by the handler
+    // unless zeroCopy is set and they are in source.
+    template <typename H>
+    class StatsHandler {
+    public:
+        StatsHandler(H& handler, ParseStats& stats, std::string_view source,
+            const ParseOptions& options, size_t depth)
+            : handler_(handler)
+            , stats_(stats)
+            , source_(source)
+            , zeroCopy_(options.zeroCopy)
+            , internKeys_(options.internKeys || options.keyTable)
+            , depth_(depth)
+        {
+            stats_.maxDepth = std::max(stats_.maxDepth, depth_);
+        }
+
+        bool null()
+        {
+            stats_.nulls++;
+            return handler_.null();
+        }
+
+        bool boolean(Node::Bool v)
+        {
+            stats_.bools++;
+            return handler_.boolean(v);
+        }
+
+        bool integer(Node::Integer v)
+        {
+            stats_.integers++;
+            return handler_.integer(v);
+        }
+
+        bool floating(Node::Float v)
+        {
+            stats_.floats++;
+            return handler_.floating(v);
+        }
+
+        bool string(std::string_view str)
+        {
+            stats_.strings++;
+            copied(str);
+            return handler_.string(str);
+        }
+
+        bool skipped() { return handler_.skipped(); }
+
+        bool key(std::string_view str)
+        {
+            stats_.keys++;
+            // Interned keys are only copied the first time they occur
+            if (!internKeys_ || str.size() <= Node::String::maxInlineSize) {
+                copied(str);
+            }
+            return handler_.key(str);
+        }
+
+        bool startArray()
+        {
+            stats_.arrays++;
+            open();
+            return handler_.startArray();
+        }
+
+        bool endArray()
+        {
+            depth_--;
+            return handler_.endArray();
+        }
+
+        bool startDictionary()
+        {
+            stats_.dictionaries++;
+            open();
+            return handler_.startDictionary();
+        }
+
+        bool endDictionary()
+        {
+            depth_--;
+            return handler_.endDictionary();
+        }
+
+    private:
+        void open()
+        {
+            depth_++;
+            stats_.maxDepth = std::max(stats_.maxDepth, depth_);
+        }
+
+        void copied(std::string_view str)
+        {
+            const std::less<const char*> less;
+            const auto inSource = !less(str.data(), source_.data())
+                && !less(source_.data() + source_.size(), str.data() + str.size());
+            if (!zeroCopy_ || !inSource) {
+                stats_.stringBytesCopied += str.size();
+            }
+        }
+
+        H& handler_;
+        ParseStats& stats_;
+        std::string_view source_;
+        bool zeroCopy_;
+        bool internKeys_;
+        size_t depth_; // of open containers
+    };
+
+    // Passes on the events of the values that are selected by ParseOptions::projection (see
+    // Projects)
+    template <typename H>
+    class ProjectingHandler {
+    public:
+        ProjectingHandler(H& handler, const PathSet& paths, bool trusted)
+            : handler_(handler)
+            , projection_(paths)
+            , trusted_(trusted)
+        {
+        }
+
+        bool selectKey(std::string_view key) { return projection_.selectKey(key); }
+        bool selectElement() { return projection_.selectElement(); }
+        bool skipped() { return handler_.skipped(); }
+        bool trusted() const { return trusted_; }
+
+        bool null() { return handler_.null(); }
+        bool boolean(Node::Bool v) { return handler_.boolean(v); }
+        bool integer(Node::Integer v) { return handler_.integer(v); }
+        bool floating(Node::Float v) { return handler_.floating(v); }
+        bool string(std::string_view str) { return handler_.string(str); }
+        bool key(std::string_view str) { return handler_.key(str); }
+
+        bool startArray()
+        {
+            projection_.open();
+            return handler_.startArray();
+        }
+
+        bool endArray()
+        {
+            projection_.close();
+            return handler_.endArray();
+        }
+
+        bool startDictionary()
+        {
+            projection_.open();
+            return handler_.startDictionary();
+        }
+
+        bool endDictionary()
+        {
+            projection_.close();
+            return handler_.endDictionary();
+        }
+
+    private:
+        H& handler_;
+        detail::Projection projection_;
+        bool trusted_;
+    };
+
+    // An arena that counts what is allocated from it
+    class CountingArena : public std::pmr::monotonic_buffer_resource {
+    public:
+        using monotonic_buffer_resource::monotonic_buffer_resource;
+
+        size_t allocations = 0;
+        size_t allocatedBytes = 0;
+
+    protected:
+        void* do_allocate(size_t bytes, size_t alignment) override
+        {
+            allocations++;
+            allocatedBytes += bytes;
+            return monotonic_buffer_resource::do_allocate(bytes, alignment);
+        }
+    };
+
+    void addStats(ParseStats& stats, const ParseStats& other)
+    {
+        stats.bytes += other.bytes;
+        stats.nulls += other.nulls;
+        stats.bools += other.bools;
+        stats.integers += other.integers;
+        stats.floats += other.floats;
+        stats.strings += other.strings;
+        stats.arrays += other.arrays;
+        stats.dictionaries += other.dictionaries;
+        stats.keys += other.keys;
+        stats.maxDepth = std::max(stats.maxDepth, other.maxDepth);
+        stats.stringBytesCopied += other.stringBytesCopied;
+        stats.escapesDecoded += other.escapesDecoded;
+        stats.allocations += other.allocations;
+        stats.allocatedBytes += other.allocatedBytes;
+    }
+
+    void addAllocations(ParseStats& stats, const std::pmr::monotonic_buffer_resource& arena)
+    {
+        const auto& counting = static_cast<const CountingArena&>(arena);
+        stats.allocations += counting.allocations;
+        stats.allocatedBytes += counting.allocatedBytes;
+    }
+
+    // The source range of an element of a container: from its key (or value in an array) to the
+    // end of its value. valueBegin is the position of the opening bracket of a container value.
+    struct ElementSpan {
+        size_t begin;
+        size_t valueBegin;
+        size_t end;
+    };
+
+    struct RecordedContainer {
+        size_t valueBegin;
+        std::vector<ElementSpan> elements;
+    };
+
+    using ContainerSpans = std::unordered_map<const Node*, std::vector<ElementSpan>>;
+
+    // Passes the events on to another handler and records the spans of the elements of every
+    // container in the order they are opened, with absolute offsets.
+    template <typename H>
+    class SpanRecorder {
+    public:
+        SpanRecorder(H& handler, const size_t& cursor, std::vector<RecordedContainer>& containers)
+            : handler_(handler)
+            , cursor_(cursor)
+            , containers_(containers)
+        {
+        }
+
+        // Starts inside of an already open container whose opening bracket is at valueBegin
+        void resume(size_t valueBegin)
+        {
+            open_.push_back(containers_.size());
+            containers_.push_back(RecordedContainer { valueBegin, {} });
+        }
+
+        void element(size_t offset) { elementBegin_ = offset; }
+
+        bool null() { return scalar() && handler_.null(); }
+        bool boolean(Node::Bool v) { return scalar() && handler_.boolean(v); }
+        bool integer(Node::Integer v) { return scalar() && handler_.integer(v); }
+        bool floating(Node::Float v) { return scalar() && handler_.floating(v); }
+        bool string(std::string_view str) { return scalar() && handler_.string(str); }
+        bool key(std::string_view str) { return handler_.key(str); }
+        bool startArray() { return open() && handler_.startArray(); }
+        bool endArray() { return close() && handler_.endArray(); }
+        bool startDictionary() { return open() && handler_.startDictionary(); }
+        bool endDictionary() { return close() && handler_.endDictionary(); }
+
+    private:
+        // The parser calls the handler with the cursor at the end of a scalar, at the bracket of a
+        // container start and after the bracket of a container end.
+        bool scalar()
+        {
+            if (!open_.empty()) {
+                containers_[open_.back()].elements.push_back(
+                    ElementSpan { elementBegin_, elementBegin_, cursor_ });
+            }
+            return true;
+        }
+
+        bool open()
+        {
+            if (!open_.empty()) {
+                containers_[open_.back()].elements.push_back(
+                    ElementSpan { elementBegin_, cursor_, 0 });
+            }
+            open_.push_back(containers_.size());
+            containers_.push_back(RecordedContainer { cursor_, {} });
+            return true;
+        }
+
+        bool close()
+        {
+            open_.pop_back();
+            if (!open_.empty()) {
+                containers_[open_.back()].elements.back().end = cursor_;
+            }
+            return true;
+        }
+
+        H& handler_;
+        const size_t& cursor_;
+        std::vector<RecordedContainer>& containers_;
+        std::vector<size_t> open_; // indices into containers_
+        size_t elementBegin_ = 0;
+    };
+
+    // Calls f with every array and dictionary in node, in pre-order
+    template <typename F>
+    void forEachContainer(const Node& node, F&& f)
+    {
+        if (!node.isArray() && !node.isDictionary()) {
+            return;
+        }
+        std::vector<const Node*> stack { &node };
+        while (!stack.empty()) {
+            const auto container = stack.back();
+            stack.pop_back();
+            f(*container);
+            const auto push = [&stack](const Node& child) {
+                if (child.isArray() || child.isDictionary()) {
+                    stack.push_back(&child);
+                }
+            };
+            if (container->isArray()) {
+                const auto& arr = container->asArray();
+                std::for_each(arr.rbegin(), arr.rend(), push);
+            } else {
+                const auto& dict = container->asDictionary();
+                std::for_each(dict.rbegin(), dict.rend(), [&](const auto& e) { push(e.second); });
+            }
+        }
+    }
+
+    // Stores the recorded spans, starting at next, of the containers in node relative to their
+    // opening bracket. They were recorded in the same order.
+    void attachSpans(ContainerSpans& spans, const Node& node,
+        std::vector<RecordedContainer>& recorded, size_t& next)
+    {
+        forEachContainer(node, [&](const Node& container) {
+            auto& rec = recorded[next++];
+            for (auto& element : rec.elements) {
+                element.begin -= rec.valueBegin;
+                element.valueBegin -= rec.valueBegin;
+                element.end -= rec.valueBegin;
+            }
+            spans[&container] = std::move(rec.elements);
+        });
+    }
+
+    // Otherwise containers would copy their elements when they grow, which allocates them from the
+    // default resource instead of the document arena.
+    static_assert(std::is_nothrow_move_constructible_v<Node>);
+    static_assert(sizeof(String) == 16 && sizeof(Node) == 16);
+
+    // Hands out a single copy of every distinct key, from a KeyTable or the arena of a document.
+    // Keys it has handed out before are found without taking the lock of the table.
+    class KeyInterner {
+    public:
+        void reset(std::pmr::memory_resource* resource, KeyTable* table)
+        {
+            resource_ = resource;
+            table_ = table;
+            keys_.clear();
+        }
+
+        std::string_view intern(std::string_view key)
+        {
+            const auto it = keys_.find(key);
+            if (it != keys_.end()) {
+                return *it;
+            }
+            std::string_view interned;
+            if (table_) {
+                interned = table_->intern(key);
+            } else {
+                const auto data = static_cast<char*>(resource_->allocate(key.size(), 1));
+                std::memcpy(data, key.data(), key.size());
+                interned = std::string_view(data, key.size());
+            }
+            keys_.insert(interned);
+            return interned;
+        }
+
+    private:
+        std::pmr::memory_resource* resource_ = nullptr;
+        KeyTable* table_ = nullptr;
+        std::unordered_set<std::string_view> keys_;
+    };
+
+    // Builds a tree from the events of a parse. The elements of all open containers are collected
+    // on shared stacks, so every container can be allocated once with its final size.
+    class DomBuilder {
+    public:
+        DomBuilder(std::string_view source, std::pmr::memory_resource* resource, bool zeroCopy)
+            : source_(source)
+            , resource_(resource)
+            , zeroCopy_(zeroCopy)
+        {
+        }
+
+        // Prepares the builder for another parse, keeping the capacity of its stacks. Keys are
+        // interned if internKeys is set, in keyTable if that is set.
+        void reset(std::string_view source, std::pmr::memory_resource* resource, bool zeroCopy,
+            bool internKeys = false, KeyTable* keyTable = nullptr)
+        {
+            source_ = source;
+            resource_ = resource;
+            zeroCopy_ = zeroCopy;
+            internKeys_ = internKeys || keyTable;
+            if (internKeys_) {
+                interner_.reset(resource, keyTable);
+            }
+        }
+
+        // Has to be called before the resource is destroyed, because an aborted parse leaves
+        // nodes allocated from it on the stacks
+        void clear()
+        {
+            clear(open_);
+            clear(keys_);
+            clear(arrayStack_);
+            clear(dictionaryStack_);
+            root_.reset();
+        }
+
+        bool null() { return value(Node(Node::Null {})); }
+        bool boolean(Node::Bool v) { return value(Node(v)); }
+        bool integer(Node::Integer v) { return value(Node(v)); }
+        bool floating(Node::Float v) { return value(Node(v)); }
+        bool string(std::string_view str) { return value(Node(makeString(str))); }
+        // An array element that was left out by a projection
+        bool skipped() { return value(Node()); }
+
+        bool key(std::string_view str)
+        {
+            if (internKeys_ && str.size() > Node::String::maxInlineSize) {
+                keys_.push_back(Node::String::reference(interner_.intern(str)));
+            } else {
+                keys_.push_back(makeString(str));
+            }
+            return true;
+        }
+
+        bool startArray()
+        {
+            open_.push_back(Container { false, arrayStack_.size() });
+            return true;
+        }
+
+        bool endArray()
+        {
+            const auto start = open_.back().start;
+            open_.pop_back();
+            Node::Array arr(std::make_move_iterator(arrayStack_.begin() + start),
+                std::make_move_iterator(arrayStack_.end()), resource_);
+            arrayStack_.resize(start);
+            return value(Node(std::move(arr)));
+        }
+
+        bool startDictionary()
+        {
+            open_.push_back(Container { true, dictionaryStack_.size() });
+            return true;
+        }
+
+        bool endDictionary()
+        {
+            const auto start = open_.back().start;
+            open_.pop_back();
+            Node::Dictionary dict(std::make_move_iterator(dictionaryStack_.begin() + start),
+                std::make_move_iterator(dictionaryStack_.end()), resource_);
+            dictionaryStack_.resize(start);
+            if (open_.empty()) {
+                root_.emplace(std::move(dict));
+                return true;
+            }
+            return value(Node(std::move(dict)));
+        }
+
+        Node::Dictionary& root() { return *root_; }
+
+    private:
+        struct Container {
+            bool isDictionary;
+            size_t start; // of its elements on the respective stack
+        };
+
+        bool value(Node node)
+        {
+            if (open_.back().isDictionary) {
+                dictionaryStack_.emplace_back(std::move(keys_.back()), std::move(node));
+                keys_.pop_back();
+            } else {
+                arrayStack_.emplace_back(std::move(node));
+            }
+            return true;
+        }
+
+        template <typename T>
+        static void clear(std::vector<T>& stack)
+        {
+            // Don't hold on to the memory of an unusually large document
+            constexpr size_t maxRetainedCapacity = 4096;
+            if (stack.capacity() > maxRetainedCapacity) {
+                std::vector<T>().swap(stack);
+            } else {
+                stack.clear();
+            }
+        }
+
+        Node::String makeString(std::string_view str) const
+        {
+            // Strings with escapes are decoded into a scratch buffer, which does not live long
+            const std::less<const char*> less;
+            const auto inSource = !less(str.data(), source_.data())
+                && !less(source_.data() + source_.size(), str.data() + str.size());
+            if (zeroCopy_ && inSource) {
+                return Node::String::reference(str);
+            }
+            return Node::String(str, resource_);
+        }
+
+        std::string_view source_;
+        std::pmr::memory_resource* resource_;
+        bool zeroCopy_;
+        bool internKeys_ = false;
+        KeyInterner interner_;
+        std::vector<Container> open_;
+        std::vector<Node::String> keys_; // of the values that are currently being parsed
+        std::vector<Node> arrayStack_;
+        std::vector<std::pair<Node::String, Node>> dictionaryStack_;
+        std::optional<Node::Dictionary> root_;
+    };
+
+    // Appends the events of a parse to the tape and string buffer of a TapeDocument
+    class TapeBuilder {
+    public:
+        TapeBuilder(std::vector<uint64_t>& tape, std::vector<char>& strings)
+            : tape_(tape)
+            , strings_(strings)
+        {
+        }
+
+        bool null() { return value(TapeTag::Null); }
+        bool boolean(Node::Bool v) { return value(v ? TapeTag::True : TapeTag::False); }
+
+        bool integer(Node::Integer v)
+        {
+            value(TapeTag::Integer);
+            tape_.push_back(static_cast<uint64_t>(v));
+            return true;
+        }
+
+        bool floating(Node::Float v)
+        {
+            uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            value(TapeTag::Float);
+            tape_.push_back(bits);
+            return true;
+        }
+
+        bool string(std::string_view str)
+        {
+            value(TapeTag::String, strings_.size());
+            appendString(str);
+            return true;
+        }
+
+        bool key(std::string_view str)
+        {
+            tape_.push_back(entry(TapeTag::Key, strings_.size()));
+            appendString(str);
+            return true;
+        }
+
+        bool startArray() { return start(TapeTag::ArrayStart); }
+        bool endArray() { return end(TapeTag::ArrayEnd); }
+        bool startDictionary() { return start(TapeTag::DictionaryStart); }
+        bool endDictionary() { return end(TapeTag::DictionaryEnd); }
+
+    private:
+        struct Container {
+            size_t start; // index of the start entry
+            size_t size;
+        };
+
+        static uint64_t entry(TapeTag tag, uint64_t payload = 0)
+        {
+            return (static_cast<uint64_t>(tag) << NodeView::tagShift) | payload;
+        }
+
+        bool value(TapeTag tag, uint64_t payload = 0)
+        {
+            if (!open_.empty()) {
+                ++open_.back().size;
+            }
+            tape_.push_back(entry(tag, payload));
+            return true;
+        }
+
+        void appendString(std::string_view str)
+        {
+            tape_.push_back(str.size());
+            strings_.insert(strings_.end(), str.begin(), str.end());
+            strings_.push_back('\0');
+        }
+
+        bool start(TapeTag tag)
+        {
+            value(tag);
+            open_.push_back(Container { tape_.size() - 1, 0 });
+            return true;
+        }
+
+        bool end(TapeTag tag)
+        {
+            const auto container = open_.back();
+            open_.pop_back();
+            tape_[container.start] |= tape_.size() - container.start;
+            tape_.push_back(entry(tag, container.size));
+            return true;
+        }
+
+        std::vector<uint64_t>& tape_;
+        std::vector<char>& strings_;
+        std::vector<Container> open_;
+    };
+
+    // Follows the structure of a document that arrives in chunks just closely enough to find the
+    // points at which a suspended Parser can resume: the start of an element after a separator.
+    // It does not validate anything, that is left to the parser.
+    class Scanner {
+    public:
+        // Returns the offset of the last resume point in chunk or npos if there is none. The
+        // offsets of the resume points that start an entry of the root dictionary are appended to
+        // rootEntries.
+        size_t scan(std::string_view chunk, std::vector<size_t>* rootEntries = nullptr);
+
+        // Whether the root dictionary was closed by '}', after which the parser ignores the rest
+        bool done() const { return open_.empty(); }
+
+    private:
+        enum class Mode { Structure, String, Escape, Comment, Value };
+        enum class State { Key, QuotedKey, RawKey, Colon, Value, Separator };
+
+        struct Container {
+            bool isDictionary;
+            State state;
+        };
+
+        // The container is a value of its parent, which is in State::Separator from then on
+        void close()
+        {
+            open_.pop_back();
+            separatorFound_ = false;
+            commaFound_ = false;
+        }
+
+        Mode mode_ = Mode::Structure;
+        std::vector<Container> open_ { Container { true, State::Key } };
+        bool separatorFound_ = false;
+        bool commaFound_ = false;
+    };
+
+    size_t Scanner::scan(std::string_view chunk, std::vector<size_t>* rootEntries)
+    {
+        auto resumePoint = std::string_view::npos;
+        size_t i = 0;
+        while (i < chunk.size() && !open_.empty()) {
+            const auto ch = chunk[i];
+            switch (mode_) {
+            case Mode::String:
+                if (ch != '"' && ch != '\\') {
+                    i = std::min(kernels.findQuoteOrBackslash(chunk, i), chunk.size());
+                    continue;
+                }
+                if (ch == '\\') {
+                    mode_ = Mode::Escape;
+                } else if (ch == '"') {
+                    mode_ = Mode::Structure;
+                    if (open_.back().state == State::QuotedKey) {
+                        open_.back().state = State::Colon;
+                    }
+                }
+                i++;
+                continue;
+            case Mode::Escape:
+                mode_ = Mode::String;
+                i++;
+                continue;
+            case Mode::Comment: {
+                // the newline is looked at again, because it is a separator
+                const auto end = chunk.find('\n', i);
+                if (end != std::string_view::npos) {
+                    mode_ = Mode::Structure;
+                }
+                i = std::min(end, chunk.size());
+                continue;
+            }
+            case Mode::Value:
+                if (isValueChar(ch)) {
+                    i++;
+                } else {
+                    mode_ = Mode::Structure;
+                }
+                continue;
+            case Mode::Structure:
+                break;
+            }
+
+            auto& top = open_.back();
+            if (ch == '#' && top.state != State::RawKey) {
+                mode_ = Mode::Comment;
+                i++;
+                continue;
+            }
+            const auto whitespace = isWhitespace(ch);
+            switch (top.state) {
+            case State::Key:
+                if (ch == '}') {
+                    close();
+                } else if (ch == '"') {
+                    top.state = State::QuotedKey;
+                    mode_ = Mode::String;
+                } else if (ch == ':') {
+                    top.state = State::Value;
+                } else if (!whitespace) {
+                    top.state = State::RawKey;
+                }
+                break;
+            case State::QuotedKey:
+                break;
+            case State::RawKey:
+            case State::Colon:
+                if (ch == ':') {
+                    top.state = State::Value;
+                }
+                break;
+            case State::Value:
+                if (whitespace) {
+                    break;
+                }
+                if (ch == ']' && !top.isDictionary) {
+                    close();
+                    break;
+                }
+                top.state = State::Separator;
+                separatorFound_ = false;
+                commaFound_ = false;
+                if (ch == '{') {
+                    open_.push_back(Container { true, State::Key });
+                } else if (ch == '[') {
+                    open_.push_back(Container { false, State::Value });
+                } else if (ch == '"') {
+                    mode_ = Mode::String;
+                } else if (isValueChar(ch)) {
+                    mode_ = Mode::Value;
+                }
+                break;
+            case State::Separator:
+                if (ch == '\n') {
+                    separatorFound_ = true;
+                } else if (ch == ',' && !commaFound_) {
+                    separatorFound_ = true;
+                    commaFound_ = true;
+                } else if (ch == (top.isDictionary ? '}' : ']')) {
+                    close();
+                } else if (!whitespace) {
+                    if (separatorFound_) {
+                        resumePoint = i;
+                        if (rootEntries && open_.size() == 1) {
+                            rootEntries->push_back(i);
+                        }
+                    }
+                    // the next element starts with this character
+                    top.state = top.isDictionary ? State::Key : State::Value;
+                    continue;
+                }
+                break;
+            }
+            i++;
+        }
+        return resumePoint;
+    }
+
+    // Parsing many small documents on a thread (e.g. in parseBatch) should not allocate new stacks
+    // for every one of them
+    DomBuilder& threadBuilder()
+    {
+        thread_local DomBuilder builder({}, nullptr, false);
+        return builder;
+    }
+
+    // Calls work(i) for every i < count on up to numThreads threads (0 means one per hardware
+    // thread), which take the next index from a shared counter until all are done.
+    template <typename Work>
+    void forEachParallel(size_t count, size_t numThreads, Work work)
+    {
+        if (numThreads == 0) {
+            numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        numThreads = std::min(numThreads, count);
+
+        std::atomic<size_t> next { 0 };
+        const auto run = [&] {
+            for (auto i = next++; i < count; i = next++) {
+                work(i);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < numThreads; ++i) {
+            threads.emplace_back(run);
+        }
+        run();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    template <typename Parse>
+    std::vector<ParseResult<Document>> parseBatch(size_t count, size_t numThreads, Parse parse)
+    {
+        std::vector<std::optional<ParseResult<Document>>> results(count);
+        forEachParallel(count, numThreads, [&](size_t i) { results[i].emplace(parse(i)); });
+
+        std::vector<ParseResult<Document>> ret;
+        ret.reserve(count);
+        for (auto& res : results) {
+            ret.push_back(std::move(*res));
+        }
+        return ret;
+    }
+
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> makeArena(
+        const ParseOptions& options, size_t sourceSize)
+    {
+        // Nodes take up a few times the space of the text they were parsed from, so the source size
+        // is a decent first block size. The arena grows geometrically from there.
+        constexpr size_t minArenaSize = 1024;
+        const auto arenaSize
+            = options.arenaSize ? options.arenaSize : std::max(sourceSize, minArenaSize);
+        const auto upstream
+            = options.upstream ? options.upstream : std::pmr::get_default_resource();
+        if (options.stats) {
+            return std::make_unique<CountingArena>(arenaSize, upstream);
+        }
+        return std::make_unique<std::pmr::monotonic_buffer_resource>(arenaSize, upstream);
+    }
+
+    // A range of entries of the root dictionary, which is parsed on its own
+    struct RootChunk {
+        size_t begin;
+        size_t end;
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+        std::optional<Node::Dictionary> entries; // allocated from arena
+        ParseStats stats; // if ParseOptions::stats is set
+    };
+
+    // Splits the root dictionary at entry boundaries and parses the chunks on multiple threads.
+    // Returns nullopt if the document is not worth splitting or if any chunk has an error, which is
+    // then left to the serial parser, so it is reported exactly as usual.
+    std::optional<std::vector<RootChunk>> parseRootChunks(
+        std::string_view str, const ParseOptions& options)
+    {
+        constexpr size_t minParallelSize = 1024 * 1024;
+        const auto numThreads = options.numThreads
+            ? options.numThreads
+            : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        if (numThreads == 1 || str.size() < minParallelSize || options.recordSpans
+            || options.projection) {
+            return std::nullopt;
+        }
+
+        std::vector<size_t> entries;
+        Scanner().scan(str, &entries);
+
+        // A few chunks per thread even out differences in how long they take to parse
+        const auto numChunks = std::min(entries.size() + 1, numThreads * 4);
+        std::vector<RootChunk> chunks;
+        size_t begin = 0;
+        auto entry = entries.begin();
+        for (size_t i = 1; i < numChunks; ++i) {
+            entry = std::lower_bound(entry, entries.end(), str.size() / numChunks * i);
+            if (entry == entries.end()) {
+                break;
+            }
+            if (*entry > begin) {
+                chunks.push_back(RootChunk { begin, *entry, nullptr, std::nullopt, {} });
+                begin = *entry;
+            }
+        }
+        chunks.push_back(RootChunk { begin, str.size(), nullptr, std::nullopt, {} });
+        if (chunks.size() < 2) {
+            return std::nullopt;
+        }
+
+        std::atomic<bool> failed { false };
+        forEachParallel(chunks.size(), numThreads, [&](size_t i) {
+            auto& chunk = chunks[i];
+            const auto last = i + 1 == chunks.size();
+            chunk.arena = makeArena(options, chunk.end - chunk.begin);
+            auto& builder = threadBuilder();
+            builder.reset(
+                str, chunk.arena.get(), options.zeroCopy, options.internKeys, options.keyTable);
+            builder.startDictionary();
+            const auto parseChunk = [&](auto& handler) {
+                Parser<std::remove_reference_t<decltype(handler)>> parser(handler);
+                parser.resume(true);
+                size_t cursor = chunk.begin;
+                // Unless it is the last one, the chunk ends where the next entry starts
+                const auto err = parser.parse(str.substr(0, chunk.end), cursor, last);
+                chunk.stats.escapesDecoded = parser.escapes();
+                return !err && (last || parser.atRoot());
+            };
+            // The root dictionary is already open
+            StatsHandler<DomBuilder> stats(builder, chunk.stats, str, options, 1);
+            if (!(options.stats ? parseChunk(stats) : parseChunk(builder))) {
+                failed = true;
+            } else {
+                if (!last) {
+                    builder.endDictionary();
+                }
+                chunk.entries.emplace(std::move(builder.root()));
+            }
+            builder.clear();
+        });
+        if (failed) {
+            return std::nullopt;
+        }
+        return chunks;
+    }
+
+    // A file in memory, which owner keeps alive
+    struct FileContents {
+        std::string_view data;
+        std::shared_ptr<const void> owner;
+    };
+
+    // Only regular files that are not empty can be mapped
+    std::optional<FileContents> mapFile([[maybe_unused]] FILE* file)
+    {
+#ifdef JOML_HAVE_MMAP
+        struct stat st;
+        const auto fd = ::fileno(file);
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            const auto size = static_cast<size_t>(st.st_size);
+            const auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                ::madvise(data, size, MADV_SEQUENTIAL);
+                return FileContents { std::string_view(static_cast<const char*>(data), size),
+                    std::shared_ptr<const void>(
+                        data, [size](const void* p) { ::munmap(const_cast<void*>(p), size); }) };
+            }
+        }
+#endif
+        return std::nullopt;
+    }
+
+    std::optional<FileContents> readFile(const std::string& path)
+    {
+        const std::unique_ptr<FILE, int (*)(FILE*)> file(
+            std::fopen(path.c_str(), "rb"), std::fclose);
+        if (!file) {
+            return std::nullopt;
+        }
+        if (auto contents = mapFile(file.get())) {
+            return contents;
+        }
+        auto buffer = std::make_shared<std::string>();
+        std::vector<char> chunk(64 * 1024);
+        while (const auto n = std::fread(chunk.data(), 1, chunk.size(), file.get())) {
+            buffer->append(chunk.data(), n);
+        }
+        if (std::ferror(file.get())) {
+            return std::nullopt;
+        }
+        return FileContents { *buffer, buffer };
+    }
+
+    // Binary format: a header, followed by the root dictionary. Every value is a tag, followed by
+    // its payload. Sizes, counts and integers (zigzag-encoded) are LEB128 varints, floats and the
+    // header fields are little-endian.
+    constexpr std::string_view binaryMagic { "JOMLBIN\0", 8 };
+    constexpr uint32_t binaryVersion = 1;
+    constexpr size_t binaryHeaderSize = 24; // magic, version, reserved, source hash
+
+    enum class BinaryTag : uint8_t {
+        Null,
+        False,
+        True,
+        Integer, // varint
+        Float, // 8 bytes
+        String, // size, characters
+        Array, // count, values
+        Dictionary, // count, (key size, key characters, value) per entry
+    };
+
+    void writeFixed(std::string& out, uint64_t v, size_t numBytes)
+    {
+        for (size_t i = 0; i < numBytes; ++i) {
+            out.push_back(static_cast<char>(v >> (i * 8)));
+        }
+    }
+
+    void writeVarint(std::string& out, uint64_t v)
+    {
+        while (v >= 0x80) {
+            out.push_back(static_cast<char>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<char>(v));
+    }
+
+    void writeBinaryString(std::string& out, std::string_view str)
+    {
+        writeVarint(out, str.size());
+        out.append(str);
+    }
+
+    // Writes a scalar or the tag and size of a container, whose elements follow
+    void writeBinaryValue(std::string& out, const Node& node)
+    {
+        if (node.isDictionary()) {
+            out.push_back(static_cast<char>(BinaryTag::Dictionary));
+            writeVarint(out, node.asDictionary().size());
+        } else if (node.isArray()) {
+            out.push_back(static_cast<char>(BinaryTag::Array));
+            writeVarint(out, node.asArray().size());
+        } else if (node.isString()) {
+            out.push_back(static_cast<char>(BinaryTag::String));
+            writeBinaryString(out, node.asString());
+        } else if (node.isInteger()) {
+            const auto v = static_cast<uint64_t>(node.asInteger());
+            out.push_back(static_cast<char>(BinaryTag::Integer));
+            writeVarint(out, (v << 1) ^ (node.asInteger() < 0 ? ~uint64_t(0) : 0));
+        } else if (node.is<Node::Float>()) {
+            uint64_t bits;
+            std::memcpy(&bits, &node.asFloat(), sizeof(bits));
+            out.push_back(static_cast<char>(BinaryTag::Float));
+            writeFixed(out, bits, sizeof(bits));
+        } else if (node.isBool()) {
+            out.push_back(static_cast<char>(node.asBool() ? BinaryTag::True : BinaryTag::False));
+        } else {
+            assert(node.isNull() && "Invalid node type");
+            out.push_back(static_cast<char>(BinaryTag::Null));
+        }
+    }
+
+    // Keeps the open containers on a stack instead of recursing, like readBinary, so deep nesting
+    // can not overflow the call stack
+    void writeBinary(std::string& out, const Node::Dictionary& root)
+    {
+        struct Container {
+            const Node::Dictionary* dictionary; // nullptr for an array
+            const Node::Array* array;
+            size_t next; // element to write next
+        };
+        out.push_back(static_cast<char>(BinaryTag::Dictionary));
+        writeVarint(out, root.size());
+        std::vector<Container> open { Container { &root, nullptr, 0 } };
+        while (!open.empty()) {
+            auto& top = open.back();
+            const auto size = top.dictionary ? top.dictionary->size() : top.array->size();
+            if (top.next == size) {
+                open.pop_back();
+                continue;
+            }
+            const Node* value;
+            if (top.dictionary) {
+                const auto& [key, v] = (*top.dictionary)[top.next];
+                writeBinaryString(out, key);
+                value = &v;
+            } else {
+                value = &(*top.array)[top.next];
+            }
+            top.next++;
+            writeBinaryValue(out, *value);
+            if (value->isDictionary()) {
+                open.push_back(Container { &value->asDictionary(), nullptr, 0 });
+            } else if (value->isArray()) {
+                open.push_back(Container { nullptr, &value->asArray(), 0 });
+            }
+        }
+    }
+
+    // Every read fails once the data is exhausted or malformed, after which the reader stays
+    // failed, so callers only have to check ok() at the end.
+    class BinaryReader {
+    public:
+        explicit BinaryReader(std::string_view data) : data_(data) { }
+
+        bool ok() const { return ok_; }
+        bool atEnd() const { return cursor_ == data_.size(); }
+
+        std::string_view bytes(size_t size)
+        {
+            if (!ok_ || size > data_.size() - cursor_) {
+                ok_ = false;
+                return data_.substr(cursor_, 0);
+            }
+            cursor_ += size;
+            return data_.substr(cursor_ - size, size);
+        }
+
+        uint64_t fixed(size_t numBytes)
+        {
+            uint64_t v = 0;
+            const auto str = bytes(numBytes);
+            for (size_t i = 0; i < str.size(); ++i) {
+                v |= static_cast<uint64_t>(static_cast<uint8_t>(str[i])) << (i * 8);
+            }
+            return v;
+        }
+
+        uint64_t varint()
+        {
+            uint64_t v = 0;
+            for (size_t shift = 0; ok_ && shift < 64; shift += 7) {
+                const auto byte = static_cast<uint8_t>(fixed(1));
+                v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return v;
+                }
+            }
+            ok_ = false;
+            return 0;
+        }
+
+        std::string_view string() { return bytes(varint()); }
+
+    private:
+        std::string_view data_;
+        size_t cursor_ = 0;
+        bool ok_ = true;
+    };
+
+    // Replays the tree in data as events without recursion, so corrupt data can not overflow the
+    // stack. Returns false if data is not exactly one root dictionary.
+    bool readBinary(std::string_view data, DomBuilder& builder)
+    {
+        struct Container {
+            bool isDictionary;
+            uint64_t remaining;
+        };
+        BinaryReader reader(data);
+        if (reader.fixed(1) != static_cast<uint8_t>(BinaryTag::Dictionary)) {
+            return false;
+        }
+        builder.startDictionary();
+        std::vector<Container> open { Container { true, reader.varint() } };
+        while (reader.ok() && !open.empty()) {
+            auto& top = open.back();
+            if (top.remaining == 0) {
+                top.isDictionary ? builder.endDictionary() : builder.endArray();
+                open.pop_back();
+                continue;
+            }
+            --top.remaining;
+            if (top.isDictionary) {
+                builder.key(reader.string());
+            }
+            switch (static_cast<BinaryTag>(reader.fixed(1))) {
+            case BinaryTag::Null:
+                builder.null();
+                break;
+            case BinaryTag::False:
+                builder.boolean(false);
+                break;
+            case BinaryTag::True:
+                builder.boolean(true);
+                break;
+            case BinaryTag::Integer: {
+                const auto v = reader.varint();
+                builder.integer(static_cast<Node::Integer>((v >> 1) ^ (~(v & 1) + 1)));
+                break;
+            }
+            case BinaryTag::Float: {
+                const auto bits = reader.fixed(sizeof(uint64_t));
+                Node::Float v;
+                std::memcpy(&v, &bits, sizeof(v));
+                builder.floating(v);
+                break;
+            }
+            case BinaryTag::String:
+                builder.string(reader.string());
+                break;
+            case BinaryTag::Array:
+                builder.startArray();
+                open.push_back(Container { false, reader.varint() });
+                break;
+            case BinaryTag::Dictionary:
+                builder.startDictionary();
+                open.push_back(Container { true, reader.varint() });
+                break;
+            default:
+                return false;
+            }
+        }
+        return reader.ok() && reader.atEnd();
+    }
+
+    // Routes the events of a parse into the targets of parseInto. Returns false on a type mismatch,
+    // which aborts the parse at the position of the value.
+    class Binder final : public Handler {
+    public:
+        explicit Binder(detail::Target root) : root_(root) { }
+
+        bool mismatch() const { return mismatch_; }
+
+        bool null() override
+        {
+            const auto target = destination();
+            if (target.ops && target.ops->null) {
+                return target.ops->null(target.object);
+            }
+            return value(target, &detail::TargetOps::null);
+        }
+
+        bool boolean(Node::Bool v) override
+        {
+            return value(destination(), &detail::TargetOps::boolean, v);
+        }
+
+        bool integer(Node::Integer v) override
+        {
+            return value(destination(), &detail::TargetOps::integer, v);
+        }
+
+        bool floating(Node::Float v) override
+        {
+            return value(destination(), &detail::TargetOps::floating, v);
+        }
+
+        bool string(std::string_view str) override
+        {
+            return value(destination(), &detail::TargetOps::string, str);
+        }
+
+        bool key(std::string_view str) override
+        {
+            const auto& top = open_.back().target;
+            next_ = top.ops ? top.ops->field(top.object, str) : detail::Target {};
+            return true;
+        }
+
+        bool startArray() override { return start(false, &detail::TargetOps::startArray); }
+        bool endArray() override { return end(); }
+        bool startDictionary() override { return start(true, &detail::TargetOps::startDictionary); }
+        bool endDictionary() override { return end(); }
+
+    private:
+        struct Container {
+            detail::Target target; // null if it is skipped
+            bool isDictionary;
+        };
+
+        detail::Target destination()
+        {
+            if (open_.empty()) {
+                return root_;
+            }
+            const auto& top = open_.back();
+            if (top.isDictionary) {
+                return next_;
+            }
+            return top.target.ops ? top.target.ops->element(top.target.object) : detail::Target {};
+        }
+
+        // Optionals forward every value except null to the object they contain
+        static detail::Target unwrap(detail::Target target)
+        {
+            while (target.ops && target.ops->emplace) {
+                target = target.ops->emplace(target.object);
+            }
+            return target;
+        }
+
+        template <typename Op, typename... Args>
+        bool value(detail::Target target, Op op, Args... args)
+        {
+            target = unwrap(target);
+            if (!target.ops) {
+                return true;
+            }
+            if (!(target.ops->*op) || !(target.ops->*op)(target.object, args...)) {
+                mismatch_ = true;
+                return false;
+            }
+            return true;
+        }
+
+        bool start(bool isDictionary, bool (*detail::TargetOps::*op)(void*))
+        {
+            const auto target = unwrap(destination());
+            if (!value(target, op)) {
+                return false;
+            }
+            open_.push_back(Container { target, isDictionary });
+            return true;
+        }
+
+        bool end()
+        {
+            open_.pop_back();
+            return true;
+        }
+
+        detail::Target root_;
+        std::vector<Container> open_;
+        detail::Target next_; // of the value after the last key
+        bool mismatch_ = false;
+    };
+
+    // A container on the path from the root to an edit, with absolute offsets in the old source
+    struct SpanLevel {
+        const Node* container;
+        size_t valueBegin; // of its opening bracket, 0 for the root
+        size_t end; // after its closing bracket
+        size_t index; // of the container in its parent
+    };
+
+    Node& elementValue(const Node& container, size_t index)
+    {
+        // Nodes below the root of a document are never created const
+        if (container.isDictionary()) {
+            return const_cast<Node&>(container.asDictionary()[index].second);
+        }
+        return const_cast<Node&>(container.asArray()[index]);
+    }
+
+    enum class Reparsed {
+        Replaced,
+        Widen, // the run parses differently in context, so its container has to be parsed again
+        Invalid, // the run has an error that a full parse runs into as well
+    };
+
+    // Parses the run of elements of the innermost container in path that the edit touches again
+    // and replaces their values in place. Fails without changing the document unless the run
+    // parses to as many elements with the same keys.
+    Reparsed reparseElements(ContainerSpans& spans, const std::vector<SpanLevel>& path,
+        const Edit& edit, std::string_view newSource, std::pmr::memory_resource* arena,
+        const ParseOptions& options, size_t& reparsedBytes)
+    {
+        const auto& level = path.back();
+        const auto isRoot = path.size() == 1;
+        const auto isDictionary = level.container->isDictionary();
+        const auto base = level.valueBegin;
+        auto& elements = spans[level.container];
+        const auto n = elements.size();
+        // Moves an offset after the edit (or relative to something before it) to the new source
+        const auto removed = edit.end - edit.begin;
+        const auto shift = [&](size_t& offset) { offset = offset - removed + edit.text.size(); };
+
+        // An edit in the gap between two elements may join them or change the separator, so both
+        // are parsed again. One before the first or after the last element is parsed from the
+        // opening or up to the closing bracket.
+        const auto endsAfter = std::partition_point(elements.begin(), elements.end(),
+            [&](const ElementSpan& e) { return base + e.end < edit.begin; });
+        auto first = static_cast<size_t>(endsAfter - elements.begin());
+        auto regionBegin = isRoot ? 0 : base + 1;
+        if (first < n && base + elements[first].begin <= edit.begin) {
+            regionBegin = base + elements[first].begin;
+        } else if (first > 0) {
+            first--;
+            regionBegin = base + elements[first].begin;
+        }
+        const auto beginsAfter = std::partition_point(elements.begin(), elements.end(),
+            [&](const ElementSpan& e) { return base + e.begin <= edit.end; });
+        auto last = static_cast<size_t>(beginsAfter - elements.begin()); // exclusive
+        auto regionEnd = level.end;
+        auto toClose = false;
+        if (last > 0 && edit.end <= base + elements[last - 1].end) {
+            regionEnd = base + elements[last - 1].end;
+        } else if (last < n) {
+            regionEnd = base + elements[last].end;
+            last++;
+        } else {
+            toClose = true;
+        }
+        shift(regionEnd);
+        reparsedBytes += regionEnd - regionBegin;
+
+        auto& builder = threadBuilder();
+        builder.reset(newSource, arena, false, options.internKeys, options.keyTable);
+        // The elements end up in a dictionary or an array under the key "" in a root dictionary
+        builder.startDictionary();
+        if (!isDictionary) {
+            builder.key("");
+            builder.startArray();
+        }
+        std::vector<RecordedContainer> recorded;
+        size_t cursor = regionBegin;
+        SpanRecorder<DomBuilder> recorder(builder, cursor, recorded);
+        recorder.resume(base);
+        Parser<SpanRecorder<DomBuilder>> parser(recorder);
+        parser.resume(isDictionary);
+        // What follows the run is unchanged, so it parses the same as before if the run ends with
+        // a value where it ended before, rather than in a comment or a string that goes on. A run
+        // up to the closing bracket has to end with it, unless it is the rest of the root.
+        const auto atEnd = toClose && isRoot;
+        const auto str = atEnd ? newSource : newSource.substr(0, regionEnd);
+        const auto err = parser.parse(str, cursor, atEnd);
+        const auto& parsedElements = recorded[0].elements;
+        const auto ended = toClose
+            ? parser.done() && (atEnd || cursor == regionEnd)
+            : parser.atRoot() && !parsedElements.empty() && parsedElements.back().end == regionEnd;
+        if (err || !ended) {
+            builder.clear();
+            // The parser is where a full parse would be until it leaves the container, so errors
+            // inside of it are real, unless they are due to the source being cut off at the end
+            const auto real = err && (atEnd || err->offset < str.size());
+            return real ? Reparsed::Invalid : Reparsed::Widen;
+        }
+        if (!toClose && !isDictionary) {
+            builder.endArray();
+        }
+        if (!toClose || !isDictionary) {
+            builder.endDictionary();
+        }
+
+        auto& root = builder.root();
+        const auto count = last - first;
+        const auto numParsed = isDictionary ? root.size() : root[0].second.asArray().size();
+        auto matches = numParsed == count;
+        for (size_t k = 0; matches && isDictionary && k < count; k++) {
+            matches = root[k].first == level.container->asDictionary()[first + k].first;
+        }
+        if (!matches) {
+            builder.clear();
+            return Reparsed::Widen;
+        }
+
+        for (size_t k = 0; k < count; k++) {
+            auto& value = elementValue(*level.container, first + k);
+            forEachContainer(value, [&](const Node& container) { spans.erase(&container); });
+            auto& parsed = isDictionary ? root[k].second : elementValue(root[0].second, k);
+            // The old value stays in the arena like everything else, which is never destroyed
+            new (&value) Node(std::move(parsed));
+        }
+        builder.clear();
+
+        for (size_t k = 0; k < count; k++) {
+            auto& element = elements[first + k];
+            element.begin = parsedElements[k].begin - base;
+            element.valueBegin = parsedElements[k].valueBegin - base;
+            element.end = parsedElements[k].end - base;
+        }
+        size_t next = 1;
+        for (size_t k = 0; k < count; k++) {
+            attachSpans(spans, elementValue(*level.container, first + k), recorded, next);
+        }
+
+        // Everything after the run moves, as do the ends of the containers around it
+        for (auto i = last; i < n; i++) {
+            shift(elements[i].begin);
+            shift(elements[i].valueBegin);
+            shift(elements[i].end);
+        }
+        for (auto l = path.size() - 1; l > 0; l--) {
+            auto& parentElements = spans[path[l - 1].container];
+            shift(parentElements[path[l].index].end);
+            for (auto i = path[l].index + 1; i < parentElements.size(); i++) {
+                shift(parentElements[i].begin);
+                shift(parentElements[i].valueBegin);
+                shift(parentElements[i].end);
+            }
+        }
+        return Reparsed::Replaced;
+    }
+
+    uint64_t mixHash(uint64_t h, uint64_t word)
+    {
+        h = (h ^ word) * 0x9e3779b97f4a7c15;
+        return h ^ (h >> 32);
+    }
+
+    // The hash of a scalar, or the seed of the hash of a container that its elements are mixed into
+    uint64_t shallowHash(const Node& node)
+    {
+        const auto typed
+            = [](uint64_t type, uint64_t word) { return mixHash(mixHash(0, type), word); };
+        if (node.isInteger()) {
+            return typed(1, static_cast<uint64_t>(node.asInteger()));
+        } else if (node.isFloat()) {
+            // Floats that compare equal have to hash the same, like 0.0 and -0.0 or any two NaNs
+            auto v = node.asFloat();
+            if (v == 0) {
+                v = 0;
+            } else if (std::isnan(v)) {
+                v = std::numeric_limits<Node::Float>::quiet_NaN();
+            }
+            uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            return typed(2, bits);
+        } else if (node.isString()) {
+            return typed(3, hashSource(node.asString()));
+        } else if (node.isBool()) {
+            return typed(4, node.asBool());
+        } else if (node.isNull()) {
+            return typed(5, 0);
+        } else if (node.isArray()) {
+            return typed(6, node.asArray().size());
+        } else if (node.isDictionary()) {
+            return typed(7, node.asDictionary().size());
+        }
+        return typed(8, 0);
+    }
+}
+
+SourceMap::SourceMap(std::string_view source) : source_(source), lineStarts_ { 0 }
+{
+    size_t cursor = 0;
+    while (const auto nl = std::memchr(source.data() + cursor, '\n', source.size() - cursor)) {
+        cursor = static_cast<size_t>(static_cast<const char*>(nl) - source.data()) + 1;
+        lineStarts_.push_back(cursor);
+    }
+}
+
+Position SourceMap::position(size_t offset) const
+{
+    offset = std::min(offset, source_.size());
+    const auto next = std::upper_bound(lineStarts_.begin(), lineStarts_.end(), offset);
+    const auto line = static_cast<size_t>(next - lineStarts_.begin());
+    const auto lineStart = lineStarts_[line - 1];
+    return Position { line, 1 + countCodePoints(source_.substr(lineStart, offset - lineStart)) };
+}
+
+std::string_view SourceMap::line(size_t line) const
+{
+    if (line == 0 || line > lineStarts_.size()) {
+        return {};
+    }
+    const auto start = lineStarts_[line - 1];
+    const auto end = line < lineStarts_.size() ? lineStarts_[line] - 1 : source_.size();
+    return source_.substr(start, end - start);
+}
+
+std::string SourceMap::context(const Position& position, size_t numContextLines) const
+{
+    const auto startLine = position.line > numContextLines ? position.line - numContextLines : 1;
+    const auto endLine = std::min(lineStarts_.size(), position.line + numContextLines);
+    std::string ret;
+    for (auto i = startLine; i <= endLine; ++i) {
+        ret.append(line(i));
+        ret.append("\n");
+        if (i == position.line) {
+            ret.append(position.column - 1, ' ');
+            ret.append("^\n");
+        }
+    }
+    return ret;
+}
+
+std::string getContextString(std::string_view str, const Position& position)
+{
+    return SourceMap(str).context(position);
+}
+
+std::ostream& operator<<(std::ostream& os, const String& str)
+{
+    return os << std::string_view(str);
+}
+
+#ifdef JOML_TRACING
+void setTraceHook(TraceHook hook)
+{
+    traceHook.store(hook, std::memory_order_relaxed);
+}
+#endif
+
+std::optional<ParseError> parse(std::string_view str, Handler& handler)
+{
+    return parseRoot(str, handler);
+}
+
+std::optional<ParseError> detail::parseInto(std::string_view str, Target root)
+{
+    Binder binder(root);
+    auto err = parseRoot(str, binder);
+    if (err && binder.mismatch()) {
+        err->type = ParseError::Type::TypeMismatch;
+    }
+    return err;
+}
+
+ParseResult<Node::Dictionary> parse(std::string_view str)
+{
+    auto& builder = threadBuilder();
+    builder.reset(str, std::pmr::get_default_resource(), false);
+    if (auto err = parseRoot(str, builder)) {
+        builder.clear();
+        return *err;
+    }
+    ParseResult<Node::Dictionary> res(std::move(builder.root()));
+    builder.clear();
+    return res;
+}
+
+struct Document::Spans {
+    ContainerSpans containers; // offsets relative to the opening bracket
+    size_t sourceSize = 0;
+    size_t reparsedBytes = 0; // parsed into the arena again since the last full parse
+};
+
+Document::Document(std::unique_ptr<std::pmr::monotonic_buffer_resource> arena, const Node* root)
+    : arena_(std::move(arena))
+    , root_(root)
+{
+}
+
+Document::Document(Document&&) noexcept = default;
+Document& Document::operator=(Document&&) noexcept = default;
+Document::~Document() = default;
+
+ParseResult<Document> parse(std::string_view str, const ParseOptions& options)
+{
+    if (auto chunks = parseRootChunks(str, options)) {
+        size_t size = 0;
+        for (const auto& chunk : *chunks) {
+            size += chunk.entries->size();
+        }
+        auto arena = makeArena(options, size * sizeof(Node::Dictionary::value_type));
+        Node::Dictionary dict(arena.get());
+        dict.reserve(size);
+        for (auto& chunk : *chunks) {
+            for (auto& entry : *chunk.entries) {
+                dict.emplace_back(std::move(entry.first), std::move(entry.second));
+            }
+        }
+        const auto root = new (arena->allocate(sizeof(Node), alignof(Node))) Node(std::move(dict));
+        if (options.stats) {
+            auto& stats = *options.stats;
+            stats = ParseStats {};
+            stats.bytes = str.size();
+            stats.dictionaries = 1;
+            addAllocations(stats, *arena);
+            for (const auto& chunk : *chunks) {
+                addStats(stats, chunk.stats);
+                addAllocations(stats, *chunk.arena);
+            }
+        }
+        Document doc(std::move(arena), root);
+        doc.options_ = options;
+        doc.options_.stats = nullptr;
+        for (auto& chunk : *chunks) {
+            chunk.entries.reset();
+            doc.chunkArenas_.push_back(std::move(chunk.arena));
+        }
+        return doc;
+    }
+
+    // A projection only builds a small part of the tree, so its arena starts small instead
+    auto arena = makeArena(options, options.projection ? 0 : str.size());
+    auto& builder = threadBuilder();
+    builder.reset(str, arena.get(), options.zeroCopy, options.internKeys, options.keyTable);
+    size_t cursor = 0;
+    std::vector<RecordedContainer> recorded;
+    const auto run = [&](auto& handler) {
+        Parser<std::remove_reference_t<decltype(handler)>> parser(handler);
+        auto err = parser.parse(str, cursor, true);
+        if (options.stats) {
+            options.stats->escapesDecoded = parser.escapes();
+        }
+        return err;
+    };
+    const auto project = [&](auto& handler) {
+        if (!options.projection) {
+            return run(handler);
+        }
+        ProjectingHandler<std::remove_reference_t<decltype(handler)>> projecting(
+            handler, *options.projection, options.trustedInput);
+        return run(projecting);
+    };
+    const auto recordSpans = [&](auto& handler) {
+        if (!options.recordSpans || options.projection) {
+            return project(handler);
+        }
+        SpanRecorder<std::remove_reference_t<decltype(handler)>> recorder(
+            handler, cursor, recorded);
+        return run(recorder);
+    };
+    std::optional<ParseError> err;
+    if (options.stats) {
+        auto& stats = *options.stats;
+        stats = ParseStats {};
+        stats.bytes = str.size();
+        StatsHandler<DomBuilder> handler(builder, stats, str, options, 0);
+        err = recordSpans(handler);
+    } else {
+        err = recordSpans(builder);
+    }
+    if (err) {
+        builder.clear();
+        return resolve(*err, str);
+    }
+    // Every allocation below root is owned by the arena, so it is fine to never destroy it.
+    const auto root
+        = new (arena->allocate(sizeof(Node), alignof(Node))) Node(std::move(builder.root()));
+    builder.clear();
+    if (options.stats) {
+        addAllocations(*options.stats, *arena);
+    }
+    Document doc(std::move(arena), root);
+    doc.options_ = options;
+    doc.options_.stats = nullptr;
+    doc.options_.projection = nullptr;
+    if (options.recordSpans && !options.projection) {
+        doc.spans_ = std::make_unique<Document::Spans>();
+        doc.spans_->sourceSize = str.size();
+        size_t next = 0;
+        attachSpans(doc.spans_->containers, *root, recorded, next);
+    }
+    return doc;
+}
+
+ParseResult<TapeDocument> parseTape(std::string_view str)
+{
+    TapeDocument doc;
+    // Most documents need about one entry per 8 bytes of source. Every string and key (with its
+    // terminator) is at most as long as in the source, so the string buffer never grows.
+    doc.tape_.reserve(str.size() / 8);
+    doc.strings_.reserve(str.size() + 1);
+    TapeBuilder builder(doc.tape_, doc.strings_);
+    if (auto err = parseRoot(str, builder)) {
+        return *err;
+    }
+    return doc;
+}
+
+ParseResult<Document> parse(std::shared_ptr<const std::string> source, const ParseOptions& options)
+{
+    auto res = parse(std::string_view(*source), options);
+    if (res) {
+        (*res).source_ = std::move(source);
+    }
+    return res;
+}
+
+std::optional<ParseError> reparse(Document& doc, const Edit& edit, std::string_view newSource)
+{
+    JOML_TRACE;
+    auto spans = doc.spans_.get();
+    const auto consistent = spans && edit.begin <= edit.end && edit.end <= spans->sourceSize
+        && newSource.size() == spans->sourceSize - (edit.end - edit.begin) + edit.text.size()
+        && newSource.substr(edit.begin, edit.text.size()) == edit.text;
+    // Strings of a zeroCopy document point into the old source. Once the values that were
+    // replaced take up more of the arena than the source, a full parse compacts it.
+    if (consistent && !doc.options_.zeroCopy && spans->reparsedBytes <= newSource.size()) {
+        // Descend into the container values that the edit is strictly inside of
+        std::vector<SpanLevel> path { SpanLevel { doc.root_, 0, spans->sourceSize, 0 } };
+        while (true) {
+            const auto& level = path.back();
+            const auto& elements = spans->containers[level.container];
+            const auto next = std::partition_point(elements.begin(), elements.end(),
+                [&](const ElementSpan& e) { return level.valueBegin + e.begin <= edit.begin; });
+            if (next == elements.begin()) {
+                break;
+            }
+            const auto index = static_cast<size_t>(next - elements.begin()) - 1;
+            const auto valueBegin = level.valueBegin + elements[index].valueBegin;
+            const auto end = level.valueBegin + elements[index].end;
+            const auto& value = elementValue(*level.container, index);
+            // A container that is closed by the end of the source has no closing bracket
+            if (!(value.isArray() || value.isDictionary()) || edit.begin <= valueBegin
+                || edit.end >= end || end >= spans->sourceSize) {
+                break;
+            }
+            path.push_back(SpanLevel { &value, valueBegin, end, index });
+        }
+        // Widen the run to the parent container until it parses the same elements. Each level
+        // parses its whole container again, so after a few a full parse is cheaper.
+        constexpr size_t maxWidenings = 4;
+        for (size_t widenings = 0; !path.empty() && widenings < maxWidenings;
+             path.pop_back(), widenings++) {
+            const auto reparsed = reparseElements(spans->containers, path, edit, newSource,
+                doc.arena_.get(), doc.options_, spans->reparsedBytes);
+            if (reparsed == Reparsed::Replaced) {
+                spans->sourceSize = newSource.size();
+                return std::nullopt;
+            }
+            if (reparsed == Reparsed::Invalid) {
+                break;
+            }
+        }
+    }
+
+    // newSource does not have to outlive the call, so a zeroCopy document keeps a copy of it
+    auto res = doc.options_.zeroCopy
+        ? parse(std::make_shared<const std::string>(newSource), doc.options_)
+        : parse(newSource, doc.options_);
+    if (!res) {
+        return res.error();
+    }
+    doc = std::move(*res);
+    return std::nullopt;
+}
+
+struct DocumentBuilder::State {
+    State(const ParseOptions& options)
+        : arena(makeArena(options, 0))
+        , builder({}, arena.get(), false)
+    {
+        builder.reset({}, arena.get(), false, options.internKeys, options.keyTable);
+    }
+
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+    DomBuilder builder;
+};
+
+DocumentBuilder::DocumentBuilder(const ParseOptions& options)
+    : state_(std::make_unique<State>(options))
+{
+}
+
+DocumentBuilder::~DocumentBuilder() = default;
+
+bool DocumentBuilder::null()
+{
+    return state_->builder.null();
+}
+
+bool DocumentBuilder::boolean(Node::Bool v)
+{
+    return state_->builder.boolean(v);
+}
+
+bool DocumentBuilder::integer(Node::Integer v)
+{
+    return state_->builder.integer(v);
+}
+
+bool DocumentBuilder::floating(Node::Float v)
+{
+    return state_->builder.floating(v);
+}
+
+bool DocumentBuilder::string(std::string_view str)
+{
+    return state_->builder.string(str);
+}
+
+bool DocumentBuilder::key(std::string_view str)
+{
+    return state_->builder.key(str);
+}
+
+bool DocumentBuilder::startArray()
+{
+    return state_->builder.startArray();
+}
+
+bool DocumentBuilder::endArray()
+{
+    return state_->builder.endArray();
+}
+
+bool DocumentBuilder::startDictionary()
+{
+    return state_->builder.startDictionary();
+}
+
+bool DocumentBuilder::endDictionary()
+{
+    return state_->builder.endDictionary();
+}
+
+Document DocumentBuilder::document()
+{
+    auto& arena = state_->arena;
+    const auto root = new (arena->allocate(sizeof(Node), alignof(Node)))
+        Node(std::move(state_->builder.root()));
+    return Document(std::move(arena), root);
+}
+
+struct PushParser::State {
+    State(Handler& handler) : parser(handler) { }
+
+    // Parses the first end characters of buffer and drops them
+    std::optional<ParseError> parse(size_t end, bool atEnd)
+    {
+        const std::string_view str(buffer.data(), end);
+        size_t cursor = 0;
+        if (auto err = parser.parse(str, cursor, atEnd)) {
+            // The offset and position are relative to the start of buffer
+            err->position = getPosition(str, err->offset);
+            if (err->position.line == 1) {
+                err->position.column += column;
+            }
+            err->position.line += line;
+            err->offset += offset;
+            error = err;
+            return err;
+        }
+
+        const auto lastNewline = str.rfind('\n');
+        if (lastNewline == std::string_view::npos) {
+            column += countCodePoints(str);
+        } else {
+            line += static_cast<size_t>(std::count(str.begin(), str.end(), '\n'));
+            column = countCodePoints(str.substr(lastNewline + 1));
+        }
+        offset += end;
+        buffer.erase(0, end);
+        return std::nullopt;
+    }
+
+    Parser<Handler> parser;
+    Scanner scanner;
+    std::string buffer; // everything after the last resume point
+    std::optional<ParseError> error;
+    // Before the start of buffer, to translate errors
+    size_t offset = 0;
+    size_t line = 0; // newlines
+    size_t column = 0; // code points since the last newline
+};
+
+PushParser::PushParser(Handler& handler) : state_(std::make_unique<State>(handler)) { }
+
+PushParser::~PushParser() = default;
+
+std::optional<ParseError> PushParser::feed(std::string_view chunk)
+{
+    auto& state = *state_;
+    if (state.error || state.parser.done()) {
+        return state.error;
+    }
+    const auto scanned = state.buffer.size();
+    state.buffer.append(chunk);
+    const auto resumePoint = state.scanner.scan(chunk);
+    if (state.scanner.done()) {
+        return state.parse(state.buffer.size(), true);
+    } else if (resumePoint != std::string_view::npos) {
+        return state.parse(scanned + resumePoint, false);
+    }
+    return std::nullopt;
+}
+
+std::optional<ParseError> PushParser::finish()
+{
+    auto& state = *state_;
+    if (state.error || state.parser.done()) {
+        return state.error;
+    }
+    return state.parse(state.buffer.size(), true);
+}
+
+ParseResult<Document> parseFile(const std::string& path, const ParseOptions& options)
+{
+    const auto fileError = ParseError { ParseError::Type::CouldNotReadFile, Position { 0, 0 }, 0 };
+    const std::unique_ptr<FILE, int (*)(FILE*)> file(std::fopen(path.c_str(), "rb"), std::fclose);
+    if (!file) {
+        return fileError;
+    }
+
+    if (const auto mapping = mapFile(file.get())) {
+        auto res = parse(mapping->data, options);
+        if (res) {
+            (*res).source_ = mapping->owner;
+        }
+        return res;
+    }
+
+    DocumentBuilder builder(options);
+    PushParser parser(builder);
+    std::vector<char> chunk(64 * 1024);
+    while (const auto n = std::fread(chunk.data(), 1, chunk.size(), file.get())) {
+        if (auto err = parser.feed(std::string_view(chunk.data(), n))) {
+            return *err;
+        }
+    }
+    if (std::ferror(file.get())) {
+        return fileError;
+    }
+    if (auto err = parser.finish()) {
+        return *err;
+    }
+    return builder.document();
+}
+
+std::vector<ParseResult<Document>> parseBatch(
+    const std::vector<std::string_view>& sources, const ParseOptions& options, size_t numThreads)
+{
+    // Every thread would write to the same stats
+    auto batchOptions = options;
+    batchOptions.stats = nullptr;
+    return parseBatch(
+        sources.size(), numThreads, [&](size_t i) { return parse(sources[i], batchOptions); });
+}
+
+std::vector<ParseResult<Document>> parseFileBatch(
+    const std::vector<std::string>& paths, const ParseOptions& options, size_t numThreads)
+{
+    auto batchOptions = options;
+    batchOptions.stats = nullptr;
+    return parseBatch(
+        paths.size(), numThreads, [&](size_t i) { return parseFile(paths[i], batchOptions); });
+}
+
+uint64_t hashSource(std::string_view source)
+{
+    // Not meant to withstand an attacker, only to notice changes, at several bytes per cycle
+    constexpr uint64_t mul = 0x9e3779b97f4a7c15;
+    const auto mix = [](uint64_t h, uint64_t word) {
+        h = (h ^ word) * mul;
+        return h ^ (h >> 32);
+    };
+    const auto load = [&](size_t offset) {
+        uint64_t word;
+        std::memcpy(&word, source.data() + offset, sizeof(word));
+        return word;
+    };
+
+    // Independent lanes hide the latency of the multiplications
+    std::array<uint64_t, 4> lanes { 0xcbf29ce484222325 ^ source.size(), 1, 2, 3 };
+    size_t i = 0;
+    for (; i + sizeof(lanes) <= source.size(); i += sizeof(lanes)) {
+        for (size_t lane = 0; lane < lanes.size(); ++lane) {
+            lanes[lane] = mix(lanes[lane], load(i + lane * sizeof(uint64_t)));
+        }
+    }
+    uint64_t h = lanes[0];
+    for (size_t lane = 1; lane < lanes.size(); ++lane) {
+        h = mix(h, lanes[lane]);
+    }
+    for (; i + sizeof(uint64_t) <= source.size(); i += sizeof(uint64_t)) {
+        h = mix(h, load(i));
+    }
+    uint64_t tail = 0;
+    if (i < source.size()) {
+        std::memcpy(&tail, source.data() + i, source.size() - i);
+    }
+    h = (h ^ tail) * mul;
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9;
+    return h ^ (h >> 32);
+}
+
+std::string toBinary(const Node::Dictionary& root, uint64_t sourceHash)
+{
+    std::string out(binaryMagic);
+    writeFixed(out, binaryVersion, 4);
+    writeFixed(out, 0, 4);
+    writeFixed(out, sourceHash, 8);
+    assert(out.size() == binaryHeaderSize);
+    writeBinary(out, root);
+    return out;
+}
+
+bool writeBinaryFile(const std::string& path, const Node::Dictionary& root, uint64_t sourceHash)
+{
+    const auto data = toBinary(root, sourceHash);
+    // Concurrent writers each use their own temporary file and the last rename wins
+    const auto tmpPath = path + ".tmp" + std::to_string(std::random_device()());
+    {
+        const std::unique_ptr<FILE, int (*)(FILE*)> file(
+            std::fopen(tmpPath.c_str(), "wb"), std::fclose);
+        if (!file) {
+            return false;
+        }
+        if (std::fwrite(data.data(), 1, data.size(), file.get()) != data.size()
+            || std::fflush(file.get()) != 0) {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+    }
+    // Renaming onto an existing file fails on some platforms
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0
+        && (std::remove(path.c_str()), std::rename(tmpPath.c_str(), path.c_str()) != 0)) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+ParseResult<Document> loadBinary(
+    const std::string& path, const ParseOptions& options, std::optional<uint64_t> sourceHash)
+{
+    const auto contents = readFile(path);
+    if (!contents) {
+        return ParseError { ParseError::Type::CouldNotReadFile, Position { 0, 0 }, 0 };
+    }
+    const auto invalid = ParseError { ParseError::Type::InvalidBinary, Position { 0, 0 }, 0 };
+    BinaryReader header(contents->data);
+    if (header.bytes(binaryMagic.size()) != binaryMagic || header.fixed(4) != binaryVersion) {
+        return invalid;
+    }
+    header.fixed(4);
+    const auto hash = header.fixed(8);
+    if (!header.ok()) {
+        return invalid;
+    }
+    if (sourceHash && *sourceHash != hash) {
+        return ParseError { ParseError::Type::OutdatedBinary, Position { 0, 0 }, 0 };
+    }
+
+    const auto data = contents->data.substr(binaryHeaderSize);
+    auto arena = makeArena(options, data.size());
+    auto& builder = threadBuilder();
+    builder.reset(data, arena.get(), true, options.internKeys, options.keyTable);
+    if (!readBinary(data, builder)) {
+        builder.clear();
+        return invalid;
+    }
+    const auto root
+        = new (arena->allocate(sizeof(Node), alignof(Node))) Node(std::move(builder.root()));
+    builder.clear();
+    Document doc(std::move(arena), root);
+    doc.source_ = contents->owner;
+    doc.options_ = options;
+    doc.options_.stats = nullptr;
+    doc.options_.projection = nullptr;
+    return doc;
+}
+
+bool FileSink::write(std::string_view data)
+{
+    return std::fwrite(data.data(), 1, data.size(), file_) == data.size();
+}
+
+bool FdSink::write(std::string_view data)
+{
+    while (!data.empty()) {
+#ifdef _WIN32
+        const auto n = ::_write(fd_, data.data(),
+            static_cast<unsigned>(std::min<size_t>(data.size(), std::numeric_limits<int>::max())));
+#else
+        const auto n = ::write(fd_, data.data(), data.size());
+#endif
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+JsonWriter::JsonWriter(Sink& sink, bool pretty) : sink_(sink), pretty_(pretty) { }
+
+bool JsonWriter::write(const Node& node)
+{
+    ok_ = true;
+    open(node);
+    while (!open_.empty()) {
+        auto& top = open_.back();
+        const auto i = top.next++;
+        if (i == (top.array ? top.array->size() : top.dictionary->size())) {
+            close();
+            continue;
+        }
+        if (i > 0) {
+            buffer_.push_back(',');
+        }
+        newline(open_.size());
+        const auto depth = open_.size();
+        if (top.dictionary) {
+            const auto& [key, value] = (*top.dictionary)[i];
+            string(key);
+            buffer_.append(pretty_ ? ": " : ":");
+            open(value);
+        } else {
+            open((*top.array)[i]);
+        }
+        // Only flush between values, so the buffer is not flushed for every small value
+        if (open_.size() == depth) {
+            flushIfFull();
+        }
+    }
+    if (ok_ && !buffer_.empty()) {
+        ok_ = sink_.write(buffer_);
+    }
+    buffer_.clear();
+    return ok_;
+}
+
+void JsonWriter::open(const Node& node)
+{
+    if (node.isDictionary()) {
+        buffer_.push_back('{');
+        open_.push_back(Container { nullptr, &node.asDictionary(), 0 });
+    } else if (node.isArray()) {
+        buffer_.push_back('[');
+        open_.push_back(Container { &node.asArray(), nullptr, 0 });
+    } else if (node.isString()) {
+        string(node.asString());
+    } else if (node.isInteger()) {
+        char buf[24];
+        const auto res = std::to_chars(buf, buf + sizeof(buf), node.asInteger());
+        buffer_.append(buf, res.ptr);
+    } else if (node.isFloat()) {
+        const auto f = node.asFloat();
+        if (std::isnan(f)) {
+            buffer_.append("NaN");
+        } else if (std::isinf(f)) {
+            buffer_.append(f < 0 ? "-Infinity" : "Infinity");
+        } else {
+            char buf[32];
+            const auto res = std::to_chars(buf, buf + sizeof(buf), f);
+            buffer_.append(buf, res.ptr);
+            // Keep it a float for readers that tell them apart from integers
+            if (std::none_of(buf, res.ptr, [](char ch) { return ch == '.' || ch == 'e'; })) {
+                buffer_.append(".0");
+            }
         }
+    } else if (node.isBool()) {
+        buffer_.append(node.asBool() ? "true" : "false");
+    } else {
+        assert(node.isNull() && "Invalid node type");
+        buffer_.append("null");
     }
+}
 
-    const int numLines = static_cast<int>(lineStarts.size());
-    const int numContextLines = 1;
-    const auto startLine = std::max(1, static_cast<int>(position.line) - numContextLines);
-    const auto endLine = std::min(numLines, static_cast<int>(position.line) + numContextLines);
-    std::string ret;
-    for (int i = startLine; i <= endLine; ++i) {
-        const auto idx = i - 1;
-        const auto start = lineStarts[idx];
-        const auto end = i < numLines ? lineStarts[idx + 1] - 1 : str.size();
-        ret.append(str.substr(start, end - start));
-        ret.append("\n");
-        if (i == static_cast<int>(position.line)) {
-            ret.append(position.column - 1, ' ');
-            ret.append("^\n");
+void JsonWriter::close()
+{
+    const auto isDictionary = open_.back().dictionary != nullptr;
+    open_.pop_back();
+    newline(open_.size());
+    buffer_.push_back(isDictionary ? '}' : ']');
+}
+
+void JsonWriter::string(std::string_view str)
+{
+    static constexpr std::array<char, 16> hexDigits { '0', '1', '2', '3', '4', '5', '6', '7', '8',
+        '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    buffer_.push_back('"');
+    size_t cursor = 0;
+    while (cursor < str.size()) {
+        // Most strings are shorter than a vector, where the call to a kernel does not pay off
+        constexpr size_t minKernelSize = 32;
+        const auto next = str.size() - cursor < minKernelSize
+            ? findJsonEscapeScalar(str, cursor)
+            : kernels.findJsonEscape(str, cursor);
+        buffer_.append(str.substr(cursor, next - cursor));
+        if (next == std::string_view::npos) {
+            break;
+        }
+        const auto ch = str[next];
+        switch (ch) {
+        case '"':
+            buffer_.append("\\\"");
+            break;
+        case '\\':
+            buffer_.append("\\\\");
+            break;
+        case '\b':
+            buffer_.append("\\b");
+            break;
+        case '\f':
+            buffer_.append("\\f");
+            break;
+        case '\n':
+            buffer_.append("\\n");
+            break;
+        case '\r':
+            buffer_.append("\\r");
+            break;
+        case '\t':
+            buffer_.append("\\t");
+            break;
+        default:
+            buffer_.append("\\u00");
+            buffer_.push_back(hexDigits[static_cast<uint8_t>(ch) >> 4]);
+            buffer_.push_back(hexDigits[static_cast<uint8_t>(ch) & 0xf]);
         }
+        cursor = next + 1;
     }
-    return ret;
+    buffer_.push_back('"');
 }
 
-ParseResult<Node::Dictionary> parse(std::string_view str)
+void JsonWriter::newline(size_t depth)
+{
+    if (pretty_) {
+        buffer_.push_back('\n');
+        buffer_.append(depth * 4, ' ');
+    }
+}
+
+void JsonWriter::flushIfFull()
+{
+    constexpr size_t flushSize = 64 * 1024;
+    if (buffer_.size() >= flushSize) {
+        ok_ = ok_ && sink_.write(buffer_);
+        buffer_.clear();
+    }
+}
+
+JomlWriter::JomlWriter(Sink& sink) : sink_(sink) { }
+
+bool JomlWriter::write(const Node& node)
+{
+    ok_ = true;
+    document_ = node.isDictionary();
+    if (document_) {
+        open_.push_back(Container { nullptr, &node.asDictionary(), 0 });
+    } else {
+        open(node);
+    }
+    while (!open_.empty()) {
+        auto& top = open_.back();
+        const auto i = top.next++;
+        if (i == (top.array ? top.array->size() : top.dictionary->size())) {
+            close();
+            continue;
+        }
+        // The separators are newlines, which also allow the closing brace on a line of its own
+        const auto size = open_.size();
+        const auto depth = size - (document_ ? 1 : 0);
+        if (depth > 0 || i > 0) {
+            newline(depth);
+        }
+        if (top.dictionary) {
+            const auto& [k, value] = (*top.dictionary)[i];
+            key(k);
+            buffer_.append(": ");
+            open(value);
+        } else {
+            open((*top.array)[i]);
+        }
+        if (open_.size() == size) {
+            flushIfFull();
+        }
+    }
+    if (ok_ && !buffer_.empty()) {
+        ok_ = sink_.write(buffer_);
+    }
+    buffer_.clear();
+    return ok_;
+}
+
+void JomlWriter::open(const Node& node)
+{
+    if (node.isDictionary()) {
+        buffer_.push_back('{');
+        open_.push_back(Container { nullptr, &node.asDictionary(), 0 });
+    } else if (node.isArray()) {
+        buffer_.push_back('[');
+        open_.push_back(Container { &node.asArray(), nullptr, 0 });
+    } else if (node.isString()) {
+        string(node.asString());
+    } else if (node.isInteger()) {
+        char buf[24];
+        const auto res = std::to_chars(buf, buf + sizeof(buf), node.asInteger());
+        buffer_.append(buf, res.ptr);
+    } else if (node.isFloat()) {
+        const auto f = node.asFloat();
+        if (std::isnan(f)) {
+            buffer_.append("nan");
+        } else if (std::isinf(f)) {
+            buffer_.append(f < 0 ? "-inf" : "inf");
+        } else {
+            char buf[32];
+            const auto res = std::to_chars(buf, buf + sizeof(buf), f);
+            buffer_.append(buf, res.ptr);
+            // Otherwise it would be parsed as an integer
+            if (std::none_of(buf, res.ptr, [](char ch) { return ch == '.' || ch == 'e'; })) {
+                buffer_.append(".0");
+            }
+        }
+    } else if (node.isBool()) {
+        buffer_.append(node.asBool() ? "true" : "false");
+    } else {
+        assert(node.isNull() && "Invalid node type");
+        buffer_.append("null");
+    }
+}
+
+void JomlWriter::close()
+{
+    const auto& top = open_.back();
+    const auto isDictionary = top.dictionary != nullptr;
+    const auto empty = top.next == 1;
+    open_.pop_back();
+    if (open_.empty() && document_) {
+        if (!empty) {
+            buffer_.push_back('\n');
+        }
+        return;
+    }
+    if (!empty) {
+        newline(open_.size() - (document_ ? 1 : 0));
+    }
+    buffer_.push_back(isDictionary ? '}' : ']');
+}
+
+void JomlWriter::key(std::string_view key)
+{
+    // parseKey takes everything up to the next ':' as a raw key, but the parser skips whitespace,
+    // comments and a ',' in front of it and '"' or '}' would start something else
+    const auto bare = !key.empty() && key.find_first_of("\"}#, ") != 0
+        && key.back() != ' ' && std::none_of(key.begin(), key.end(), [](char ch) {
+               return ch == ':' || static_cast<uint8_t>(ch) < 0x20;
+           });
+    if (bare) {
+        buffer_.append(key);
+    } else {
+        string(key);
+    }
+}
+
+void JomlWriter::string(std::string_view str)
+{
+    static constexpr std::array<char, 16> hexDigits { '0', '1', '2', '3', '4', '5', '6', '7', '8',
+        '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    buffer_.push_back('"');
+    size_t cursor = 0;
+    while (cursor < str.size()) {
+        // The same characters as in JSON have to be escaped, apart from '"' and '\\' only to keep
+        // the output readable
+        constexpr size_t minKernelSize = 32;
+        const auto next = str.size() - cursor < minKernelSize
+            ? findJsonEscapeScalar(str, cursor)
+            : kernels.findJsonEscape(str, cursor);
+        buffer_.append(str.substr(cursor, next - cursor));
+        if (next == std::string_view::npos) {
+            break;
+        }
+        const auto ch = str[next];
+        switch (ch) {
+        case '"':
+            buffer_.append("\\\"");
+            break;
+        case '\\':
+            buffer_.append("\\\\");
+            break;
+        case '\b':
+            buffer_.append("\\b");
+            break;
+        case '\f':
+            buffer_.append("\\f");
+            break;
+        case '\n':
+            buffer_.append("\\n");
+            break;
+        case '\r':
+            buffer_.append("\\r");
+            break;
+        case '\t':
+            buffer_.append("\\t");
+            break;
+        default:
+            buffer_.append("\\x");
+            buffer_.push_back(hexDigits[static_cast<uint8_t>(ch) >> 4]);
+            buffer_.push_back(hexDigits[static_cast<uint8_t>(ch) & 0xf]);
+        }
+        cursor = next + 1;
+    }
+    buffer_.push_back('"');
+}
+
+void JomlWriter::newline(size_t depth)
+{
+    buffer_.push_back('\n');
+    buffer_.append(depth * 4, ' ');
+}
+
+void JomlWriter::flushIfFull()
+{
+    constexpr size_t flushSize = 64 * 1024;
+    if (buffer_.size() >= flushSize) {
+        ok_ = ok_ && sink_.write(buffer_);
+        buffer_.clear();
+    }
+}
+
+bool write(const Node& node, Sink& sink)
+{
+    return JomlWriter(sink).write(node);
+}
+
+NodeHashes::NodeHashes(const Node& root) : root_(&root)
+{
+    struct Frame {
+        const Node* node;
+        size_t entry;
+        size_t next; // element to hash next
+    };
+    entries_.push_back(Entry { shallowHash(root), 1 });
+    std::vector<Frame> open;
+    if (root.isArray() || root.isDictionary()) {
+        open.push_back(Frame { &root, 0, 0 });
+    }
+    while (!open.empty()) {
+        auto& frame = open.back();
+        const auto& node = *frame.node;
+        if (frame.next < node.size()) {
+            const auto& element = node.isArray() ? node.asArray()[frame.next]
+                                                 : node.asDictionary()[frame.next].second;
+            frame.next++;
+            const auto entry = entries_.size();
+            entries_.push_back(Entry { shallowHash(element), 1 });
+            if (element.isArray() || element.isDictionary()) {
+                open.push_back(Frame { &element, entry, 0 });
+            }
+            continue;
+        }
+
+        // The elements follow the container in pre-order, each one after the subtree of the last
+        auto& container = entries_[frame.entry];
+        container.size = entries_.size() - frame.entry;
+        const auto end = frame.entry + container.size;
+        for (size_t i = frame.entry + 1, k = 0; i < end; i += entries_[i].size, ++k) {
+            if (node.isDictionary()) {
+                container.hash = mixHash(container.hash, hashSource(node.asDictionary()[k].first));
+            }
+            container.hash = mixHash(container.hash, entries_[i].hash);
+        }
+        open.pop_back();
+    }
+}
+
+std::vector<Change> diff(const NodeHashes& a, const NodeHashes& b)
+{
+    constexpr auto none = std::numeric_limits<size_t>::max();
+    // Either a pair of nodes to compare or, without entries, a change to report
+    struct Task {
+        Change change;
+        size_t aEntry;
+        size_t bEntry;
+    };
+    const auto elementEntries = [](const NodeHashes& hashes, size_t entry, auto& out) {
+        out.clear();
+        const auto end = entry + hashes.entries_[entry].size;
+        for (auto i = entry + 1; i < end; i += hashes.entries_[i].size) {
+            out.push_back(i);
+        }
+    };
+
+    std::vector<Change> changes;
+    if (a.hash() == b.hash()) {
+        return changes;
+    }
+    std::vector<Task> stack;
+    stack.push_back(Task { Change { Change::Type::Modified, {}, &a.root(), &b.root() }, 0, 0 });
+    std::vector<Task> tasks; // of the elements of one container, in order
+    std::vector<size_t> aEntries;
+    std::vector<size_t> bEntries;
+    std::vector<size_t> nextWithKey;
+    std::vector<bool> matched;
+    std::unordered_map<std::string_view, size_t> firstWithKey;
+    while (!stack.empty()) {
+        auto task = std::move(stack.back());
+        stack.pop_back();
+        if (task.aEntry == none) {
+            changes.push_back(std::move(task.change));
+            continue;
+        }
+        const auto& x = *task.change.oldValue;
+        const auto& y = *task.change.newValue;
+        const auto arrays = x.isArray() && y.isArray();
+        if (!arrays && !(x.isDictionary() && y.isDictionary())) {
+            changes.push_back(std::move(task.change));
+            continue;
+        }
+
+        elementEntries(a, task.aEntry, aEntries);
+        elementEntries(b, task.bEntry, bEntries);
+        tasks.clear();
+        const auto add = [&](PathElement element, const Node* oldValue, const Node* newValue,
+                             size_t aEntry, size_t bEntry) {
+            auto type = Change::Type::Modified;
+            if (!oldValue) {
+                type = Change::Type::Added;
+            } else if (!newValue) {
+                type = Change::Type::Removed;
+            }
+            auto path = task.change.path;
+            path.push_back(element);
+            tasks.push_back(Task { Change { type, std::move(path), oldValue, newValue }, aEntry,
+                bEntry });
+        };
+        const auto changed = [&](size_t aEntry, size_t bEntry) {
+            return a.entries_[aEntry].hash != b.entries_[bEntry].hash;
+        };
+
+        if (arrays) {
+            const auto& xs = x.asArray();
+            const auto& ys = y.asArray();
+            for (size_t i = 0; i < std::max(xs.size(), ys.size()); ++i) {
+                if (i >= ys.size()) {
+                    add(i, &xs[i], nullptr, none, none);
+                } else if (i >= xs.size()) {
+                    add(i, nullptr, &ys[i], none, none);
+                } else if (changed(aEntries[i], bEntries[i])) {
+                    add(i, &xs[i], &ys[i], aEntries[i], bEntries[i]);
+                }
+            }
+        } else {
+            // Entries with the same keys in the same order, the common case, are matched without
+            // hashing their keys
+            const auto& xd = x.asDictionary();
+            const auto& yd = y.asDictionary();
+            size_t same = 0;
+            while (same < std::min(xd.size(), yd.size()) && xd[same].first == yd[same].first) {
+                same++;
+            }
+            firstWithKey.clear();
+            nextWithKey.assign(xd.size() - same, none);
+            matched.assign(xd.size() - same, false);
+            for (auto i = xd.size(); i-- > same;) {
+                const auto [it, inserted] = firstWithKey.try_emplace(xd[i].first, i);
+                if (!inserted) {
+                    nextWithKey[i - same] = it->second;
+                    it->second = i;
+                }
+            }
+            for (size_t j = 0; j < yd.size(); ++j) {
+                auto i = j < same ? j : none;
+                if (j >= same) {
+                    const auto it = firstWithKey.find(yd[j].first);
+                    if (it != firstWithKey.end() && it->second != none) {
+                        i = it->second;
+                        it->second = nextWithKey[i - same];
+                        matched[i - same] = true;
+                    }
+                }
+                if (i == none) {
+                    add(yd[j].first, nullptr, &yd[j].second, none, none);
+                } else if (changed(aEntries[i], bEntries[j])) {
+                    add(yd[j].first, &xd[i].second, &yd[j].second, aEntries[i], bEntries[j]);
+                }
+            }
+            for (auto i = same; i < xd.size(); ++i) {
+                if (!matched[i - same]) {
+                    add(xd[i].first, &xd[i].second, nullptr, none, none);
+                }
+            }
+        }
+        stack.insert(stack.end(), std::make_move_iterator(tasks.rbegin()),
+            std::make_move_iterator(tasks.rend()));
+    }
+    return changes;
+}
+
+std::vector<Change> diff(const Node& a, const Node& b)
+{
+    return diff(NodeHashes(a), NodeHashes(b));
+}
+
+struct Path::Step {
+    enum class Type {
+        Key,
+        Index,
+        Slice,
+        Wildcard,
+    };
+
+    Type type;
+    Key key;
+    // An index or the bounds of a slice, which count from the end if they are negative
+    int64_t begin;
+    int64_t end;
+
+    bool operator==(const Step& other) const
+    {
+        return type == other.type && key.string() == other.key.string() && begin == other.begin
+            && end == other.end;
+    }
+
+    // Calls f with each element of node that the step matches, until f returns false
+    template <typename F>
+    bool forEachMatch(const Node& node, F&& f) const
+    {
+        switch (type) {
+        case Type::Key:
+            if (node.isDictionary()) {
+                if (const auto value = node.asDictionary().find(key)) {
+                    return f(*value);
+                }
+            }
+            return true;
+        case Type::Index:
+            if (node.isArray()) {
+                const auto& array = node.asArray();
+                const auto idx = resolve(begin, array.size());
+                if (idx < array.size()) {
+                    return f(array[idx]);
+                }
+            }
+            return true;
+        case Type::Slice:
+            if (node.isArray()) {
+                const auto& array = node.asArray();
+                const auto last = resolve(end, array.size());
+                for (auto idx = resolve(begin, array.size()); idx < last; ++idx) {
+                    if (!f(array[idx])) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        case Type::Wildcard:
+            if (node.isArray()) {
+                for (const auto& element : node.asArray()) {
+                    if (!f(element)) {
+                        return false;
+                    }
+                }
+            } else if (node.isDictionary()) {
+                for (const auto& [key, value] : node.asDictionary()) {
+                    if (!f(value)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+        return true;
+    }
+
+    // Clamped to [0, size]
+    static size_t resolve(int64_t idx, size_t size)
+    {
+        const auto ssize = static_cast<int64_t>(size);
+        if (idx < 0) {
+            return static_cast<size_t>(std::max<int64_t>(0, ssize + idx));
+        }
+        return static_cast<size_t>(std::min(idx, ssize));
+    }
+};
+
+struct Path::Steps {
+    std::string string;
+    std::vector<std::string> keys; // which the steps refer to
+    std::vector<Step> steps;
+    bool single = true;
+};
+
+ParseResult<Path> Path::compile(std::string_view str)
 {
+    struct Pending {
+        Step::Type type;
+        size_t key; // index into keys
+        int64_t begin;
+        int64_t end;
+    };
+
+    auto steps = std::make_shared<Steps>();
+    std::vector<Pending> pending;
     size_t cursor = 0;
-    return parseDictionary(str, cursor, true);
+    const auto error = [&](size_t offset) {
+        return ParseError { ParseError::Type::InvalidPath,
+            Position { 1, 1 + countCodePoints(str.substr(0, offset)) }, offset };
+    };
+    const auto isKeyChar = [](char ch) {
+        return std::string_view(".[]*\" \t\r\n").find(ch) == std::string_view::npos;
+    };
+    const auto readQuoted = [&]() -> std::optional<std::string> {
+        std::string key;
+        cursor++;
+        while (cursor < str.size() && str[cursor] != '"') {
+            if (str[cursor] == '\\') {
+                cursor++;
+                if (cursor == str.size() || (str[cursor] != '"' && str[cursor] != '\\')) {
+                    return std::nullopt;
+                }
+            }
+            key.push_back(str[cursor++]);
+        }
+        if (cursor == str.size()) {
+            return std::nullopt;
+        }
+        cursor++;
+        return key;
+    };
+    const auto readInteger = [&](int64_t& value) {
+        const auto [ptr, ec] = std::from_chars(str.data() + cursor, str.data() + str.size(), value);
+        if (ec != std::errc()) {
+            return false;
+        }
+        cursor = ptr - str.data();
+        return true;
+    };
+    const auto addKey = [&](std::string key) {
+        pending.push_back(Pending { Step::Type::Key, steps->keys.size(), 0, 0 });
+        steps->keys.push_back(std::move(key));
+    };
+
+    while (cursor < str.size()) {
+        if (str[cursor] == '[') {
+            cursor++;
+            int64_t begin = 0;
+            if (cursor < str.size() && str[cursor] == '"') {
+                auto key = readQuoted();
+                if (!key) {
+                    return error(cursor);
+                }
+                addKey(std::move(*key));
+            } else if (cursor < str.size() && str[cursor] == '*') {
+                cursor++;
+                pending.push_back(Pending { Step::Type::Wildcard, 0, 0, 0 });
+            } else if (readInteger(begin) && (cursor == str.size() || str[cursor] != ':')) {
+                pending.push_back(Pending { Step::Type::Index, 0, begin, 0 });
+            } else if (cursor < str.size() && str[cursor] == ':') {
+                cursor++;
+                auto end = std::numeric_limits<int64_t>::max();
+                if (cursor < str.size() && str[cursor] != ']' && !readInteger(end)) {
+                    return error(cursor);
+                }
+                pending.push_back(Pending { Step::Type::Slice, 0, begin, end });
+            } else {
+                return error(cursor);
+            }
+            if (cursor == str.size() || str[cursor] != ']') {
+                return error(cursor);
+            }
+            cursor++;
+            continue;
+        }
+
+        // Keys and wildcards are separated from the step before them by a dot
+        if (!pending.empty()) {
+            if (str[cursor] != '.') {
+                return error(cursor);
+            }
+            cursor++;
+        }
+        if (cursor < str.size() && str[cursor] == '*') {
+            cursor++;
+            pending.push_back(Pending { Step::Type::Wildcard, 0, 0, 0 });
+        } else if (cursor < str.size() && str[cursor] == '"') {
+            auto key = readQuoted();
+            if (!key) {
+                return error(cursor);
+            }
+            addKey(std::move(*key));
+        } else {
+            const auto keyStart = cursor;
+            while (cursor < str.size() && isKeyChar(str[cursor])) {
+                cursor++;
+            }
+            if (cursor == keyStart) {
+                return error(cursor);
+            }
+            addKey(std::string(str.substr(keyStart, cursor - keyStart)));
+        }
+    }
+
+    // The keys don't move anymore, so the steps can refer to them
+    steps->string = str;
+    for (const auto& step : pending) {
+        const auto key = step.type == Step::Type::Key ? Key(steps->keys[step.key]) : Key("");
+        steps->steps.push_back(Step { step.type, key, step.begin, step.end });
+        steps->single = steps->single
+            && (step.type == Step::Type::Key || step.type == Step::Type::Index);
+    }
+    Path path;
+    path.steps_ = std::move(steps);
+    return path;
+}
+
+std::string_view Path::string() const
+{
+    return steps_ ? std::string_view(steps_->string) : std::string_view();
+}
+
+bool Path::isSingle() const
+{
+    return !steps_ || steps_->single;
+}
+
+const Node& Path::get(const Node& root) const
+{
+    if (!steps_) {
+        return root;
+    }
+    const Node* match = &Node::getInvalidNode();
+    if (steps_->single) {
+        // Without branches there is no need to go back, so this is a plain loop
+        const Node* node = &root;
+        for (const auto& step : steps_->steps) {
+            const Node* next = match;
+            step.forEachMatch(*node, [&next](const Node& element) {
+                next = &element;
+                return false;
+            });
+            node = next;
+        }
+        return *node;
+    }
+    auto first = [&match](const Node& node) {
+        match = &node;
+        return false;
+    };
+    visit(root, 0, first);
+    return *match;
+}
+
+bool Path::visit(const Node& node, size_t step, detail::FunctionRef<const Node&> f) const
+{
+    if (!steps_ || step == steps_->steps.size()) {
+        return f(node);
+    }
+    return steps_->steps[step].forEachMatch(
+        node, [&](const Node& element) { return visit(element, step + 1, f); });
+}
+
+size_t PathSet::add(Path path)
+{
+    const auto idx = paths_.size();
+    size_t trieNode = 0;
+    const auto numSteps = path.steps_ ? path.steps_->steps.size() : 0;
+    for (size_t i = 0; i < numSteps; ++i) {
+        const auto& step = path.steps_->steps[i];
+        size_t next = 0;
+        for (const auto child : nodes_[trieNode].children) {
+            const auto& other = nodes_[child];
+            if (paths_[other.path].steps_->steps[other.step] == step) {
+                next = child;
+                break;
+            }
+        }
+        if (next == 0) {
+            next = nodes_.size();
+            nodes_.push_back(TrieNode { idx, i, {}, {} });
+            nodes_[trieNode].children.push_back(next);
+        }
+        trieNode = next;
+    }
+    nodes_[trieNode].ends.push_back(idx);
+    paths_.push_back(std::move(path));
+    return idx;
+}
+
+std::vector<const Node*> PathSet::get(const Node& root) const
+{
+    std::vector<const Node*> matches(paths_.size(), nullptr);
+    evaluate(root, [&matches](size_t path, const Node& node) {
+        if (!matches[path]) {
+            matches[path] = &node;
+        }
+    });
+    for (auto& match : matches) {
+        if (!match) {
+            match = &Node::getInvalidNode();
+        }
+    }
+    return matches;
+}
+
+void PathSet::visit(
+    const Node& node, size_t trieNode, detail::FunctionRef<size_t, const Node&> f) const
+{
+    const auto& here = nodes_[trieNode];
+    for (const auto path : here.ends) {
+        f(path, node);
+    }
+    for (const auto child : here.children) {
+        const auto& next = nodes_[child];
+        paths_[next.path].steps_->steps[next.step].forEachMatch(node, [&](const Node& element) {
+            visit(element, child, f);
+            return true;
+        });
+    }
+}
+
+namespace detail {
+    Projection::Projection(const PathSet& paths)
+        : paths_(paths)
+        , active_ { 0 }
+        , selectedWhole_(!paths.nodes_[0].ends.empty())
+    {
+    }
+
+    template <typename F>
+    bool Projection::select(F matches)
+    {
+        const auto& top = open_.back();
+        active_.resize(top.end);
+        selectedWhole_ = top.whole;
+        if (top.whole) {
+            return true;
+        }
+        for (auto i = top.begin; i < top.end; ++i) {
+            for (const auto child : paths_.nodes_[active_[i]].children) {
+                const auto& node = paths_.nodes_[child];
+                if (matches(paths_.paths_[node.path].steps_->steps[node.step])) {
+                    active_.push_back(child);
+                    selectedWhole_ = selectedWhole_ || !node.ends.empty();
+                }
+            }
+        }
+        return active_.size() > top.end;
+    }
+
+    bool Projection::selectKey(std::string_view key)
+    {
+        return select([key](const Path::Step& step) {
+            return step.type == Path::Step::Type::Wildcard
+                || (step.type == Path::Step::Type::Key && step.key.string() == key);
+        });
+    }
+
+    bool Projection::selectElement()
+    {
+        // Negative indices and bounds count from the end, which is not known yet
+        const auto idx = open_.back().next++;
+        return select([idx](const Path::Step& step) {
+            switch (step.type) {
+            case Path::Step::Type::Key:
+                return false;
+            case Path::Step::Type::Index:
+                return step.begin < 0 || step.begin == idx;
+            case Path::Step::Type::Slice:
+                return (step.begin < 0 || step.begin <= idx) && (step.end < 0 || idx < step.end);
+            case Path::Step::Type::Wildcard:
+                return true;
+            }
+            return false;
+        });
+    }
+
+    void Projection::open()
+    {
+        const auto begin = open_.empty() ? 0 : open_.back().end;
+        open_.push_back(Frame { begin, active_.size(), selectedWhole_, 0 });
+    }
+}
+
+ParseResult<Document> loadOrParse(
+    const std::string& path, const std::string& cachePath, const ParseOptions& options)
+{
+    const auto source = readFile(path);
+    if (!source) {
+        return ParseError { ParseError::Type::CouldNotReadFile, Position { 0, 0 }, 0 };
+    }
+    const auto hash = hashSource(source->data);
+    // A document loaded from the cache has neither been projected nor has it spans
+    const auto useCache = !options.projection && !options.recordSpans;
+    if (useCache) {
+        if (auto cached = loadBinary(cachePath, options, hash)) {
+            return cached;
+        }
+    }
+    auto res = parse(source->data, options);
+    if (res) {
+        (*res).source_ = source->owner;
+        if (useCache) {
+            writeBinaryFile(cachePath, (*res).root().asDictionary(), hash);
+        }
+    }
+    return res;
 }
 
 } // namespace joml
@@ -0,0 +1,51 @@
+#include <cstdio>
+#include <iostream>
+
+#include "joml.hpp"
+
+std::optional<std::string> readFile(const std::string& path)
+{
+    FILE* f = ::fopen(path.c_str(), "rb");
+    if (!f) {
+        return std::nullopt;
+    }
+    std::string str;
+    char buffer[64 * 1024];
+    while (const auto n = ::fread(buffer, 1, sizeof(buffer), f)) {
+        str.append(buffer, n);
+    }
+    const auto failed = ::ferror(f);
+    ::fclose(f);
+    if (failed) {
+        return std::nullopt;
+    }
+    return str;
+}
+
+int main(int argc, char** argv)
+{
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    if (args.size() != 2) {
+        std::cerr << "Usage: joml2bin <JOML file> <binary cache file>" << std::endl;
+        return 1;
+    }
+    const auto source = readFile(args[0]);
+    if (!source) {
+        std::cerr << "Could not read file" << std::endl;
+        return 1;
+    }
+    const auto res = joml::parse(*source, joml::ParseOptions {});
+    if (!res) {
+        const auto err = res.error();
+        std::cerr << "Error parsing JOML file: " << err.string() << std::endl;
+        std::cerr << joml::getContextString(*source, err.position) << std::endl;
+        return 2;
+    }
+
+    const auto hash = joml::hashSource(*source);
+    if (!joml::writeBinaryFile(args[1], (*res).root().asDictionary(), hash)) {
+        std::cerr << "Could not write file" << std::endl;
+        return 1;
+    }
+    return 0;
+}